@@ -5,6 +5,8 @@
 
 #include <orflib/market/volatilitytermstructure.hpp>
 
+#include <cmath>
+
 BEGIN_NAMESPACE(orf)
 
 using namespace std;
@@ -53,6 +55,13 @@ void VolatilityTermStructure::initFromFwdVols()
   }
 }
 
+void VolatilityTermStructure::initFwdVols()
+{
+  // same breakpoints as the forward variances
+  fwdvols_ = fwdvars_;
+  for (size_t i = 0; i < fwdvols_.size(); ++i)
+    fwdvols_.setCoefficient(0, i, std::sqrt(fwdvars_.coefficient(0, i)));
+}
 
 double VolatilityTermStructure::spotVol(double tMat) const
 {
@@ -73,4 +82,11 @@ double VolatilityTermStructure::fwdVol(double tMat1, double tMat2) const
   return std::sqrt(fvar / (tMat2 - tMat1));  // return the annualized volatility
 }
 
+double VolatilityTermStructure::fwdVolIntegral(double tMat1, double tMat2) const
+{
+  ORF_ASSERT(tMat1 >= 0.0, "forward volatilities for negative times not allowed");
+  ORF_ASSERT(tMat1 <= tMat2, "maturities are out of order");
+  return fwdvols_.integral(tMat1, tMat2);
+}
+
 END_NAMESPACE(orf)
@@ -33,13 +33,21 @@ public:
   /** Returns the forward rate between times tMat1 and tMat2 */
   double fwdVol(double tMat1, double tMat2) const;
 
+  /** Returns the integral of the instantaneous forward vol between times tMat1 and tMat2,
+      which is the derivative of the standard deviation sqrt(int vol^2 dt) times itself
+      with respect to a parallel shift of the forward vols
+  */
+  double fwdVolIntegral(double tMat1, double tMat2) const;
+
 protected:
 private:
   // helper functions
   void initFromSpotVols();
   void initFromFwdVols();
+  void initFwdVols();
 
   PiecewisePolynomial fwdvars_;  // the piecewise constant forward variances
+  PiecewisePolynomial fwdvols_;  // and their square roots
 };
 
 using SPtrVolatilityTermStructure = std::shared_ptr<VolatilityTermStructure>;
@@ -74,6 +82,7 @@ VolatilityTermStructure::VolatilityTermStructure(XITER tMatBegin,
   default:
     ORF_ASSERT(0, "VolatilityTermStructure: unknown volatility input type");
   }
+  initFwdVols();
 }
 
 END_NAMESPACE(orf)
@@ -99,4 +99,23 @@ double YieldCurve::fwdRate(double tMat1, double tMat2) const
   return frate / (tMat2 - tMat1);  // return the annualized rate
 }
 
+size_t YieldCurve::nFwdRates() const
+{
+  return fwdrates_.size();
+}
+
+void YieldCurve::fwdRateIntegralDerivs(double tMat1, double tMat2, Vector& derivs) const
+{
+  ORF_ASSERT(tMat1 >= 0.0, "YieldCurve: negative times not allowed");
+  ORF_ASSERT(tMat1 <= tMat2, "YieldCurve: maturities are out of order");
+  size_t n = fwdrates_.size();
+  derivs.zeros(n);
+  for (size_t k = 0; k < n; ++k) {
+    double lo = std::max(tMat1, fwdrates_.breakPoint(k));
+    double hi = k + 1 < n ? std::min(tMat2, fwdrates_.breakPoint(k + 1)) : tMat2;
+    if (hi > lo)
+      derivs[k] = hi - lo;
+  }
+}
+
 END_NAMESPACE(orf)
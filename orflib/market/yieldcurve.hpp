@@ -67,6 +67,18 @@ public:
   /** Returns the forward rate between times tMat1 and tMat2 */
   double fwdRate(double tMat1, double tMat2) const;
 
+  /** Returns the number of piecewise constant forward rates the curve is made of, one per input maturity.
+      Forward rate k applies from input maturity k-1 (or t = 0) to input maturity k,
+      and the last one also beyond.
+  */
+  size_t nFwdRates() const;
+
+  /** Returns in derivs the derivatives of the integrated forward rate from tMat1 to tMat2,
+      i.e. of -log(fwdDiscount(tMat1, tMat2)), with respect to each of the nFwdRates() forward rates.
+      These are the lengths of the overlaps of [tMat1, tMat2] with the intervals of the forward rates.
+  */
+  void fwdRateIntegralDerivs(double tMat1, double tMat2, Vector& derivs) const;
+
   /** Returns the swap rate at time tMat */
   // TODO Not implemented yet, requires frequency arg
   // double swapRate(double tMat1) const;
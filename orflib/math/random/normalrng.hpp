@@ -10,12 +10,18 @@
 #include <orflib/defines.hpp>
 #include <orflib/exception.hpp>
 #include <random>
+#include <cmath>
 #include <orflib/math/random/sobolurng.hpp>
-#include <orflib/math/stats/normaldistribution.hpp>
+#include <orflib/math/vectormath.hpp>
 
 BEGIN_NAMESPACE(orf)
 
-/** Generator of normal deviates. It is templatized on the underlying uniform RNG
+/** Generator of normal deviates. It is templatized on the underlying uniform RNG.
+    For pseudo-random URNGs the uniform draws of a whole batch are taken first and then
+    mapped to normal deviates by inversion, with normalInvCdfInPlace. This is fast, gives
+    the same deviates with any compiler and standard library, and consumes exactly
+    one uniform draw per deviate. The position in the stream is then a known function
+    of the number of deviates drawn, so that the generator can skip ahead exactly with discard().
 */
 template<typename URNG>
 class NormalRng
@@ -29,31 +35,85 @@ public:
   size_t dim() const;
 
   /** Returns a batch of random deviates
-      CAUTION: it requires end - begin == dimension() */
+      CAUTION: it requires end - begin == dimension() and ITER to point to contiguous storage */
   template <typename ITER>
   void next(ITER begin, ITER end);
 
+  /** Returns the next n batches of dimension() deviates in column-major (batch, dimension)
+      layout: deviate k of batch p is written to out[k * ld + p], with ld >= n.
+      The deviates are the same as those of n calls to next().
+  */
+  void nextBlock(size_t n, double* out, size_t ld);
+
+  /** Skips the next n deviates.
+      The state after the call is the same as after drawing n deviates with next().
+  */
+  void discard(unsigned long long n);
+
+  /** Restarts the stream, seeding the underlying uniform rng with s */
+  void seed(unsigned long s);
+
   /** Returns the underlying uniform rng. */
   URNG & urng();
 
 private:
 
+  /** Returns a uniform deviate in (0, 1), using exactly one draw of the underlying rng */
+  double uniform();
+
+
   // state
   size_t dim_;      // the dimension of the generator
   URNG urng_;       // the uniform random number generator
-  std::normal_distribution<double> normcdf_;  // the normal distribution
+  double mean_;     // the mean of the distribution
+  double stdev_;    // the standard deviation of the distribution
 
 };
 
+/** Advances a uniform rng by n draws.
+    The generic version relies on URNG::discard(), whose cost is linear in n.
+*/
+template<typename URNG>
+void skipAhead(URNG& urng, unsigned long long n)
+{
+  urng.discard(n);
+}
+
+/** Advances a linear congruential rng by n draws in O(log(n)) operations.
+    The n-fold composition of the affine map x -> (a * x + c) mod m is computed
+    by repeated squaring and the engine is reseeded with the resulting state.
+*/
+template<typename UINT, UINT a, UINT c, UINT m>
+void skipAhead(std::linear_congruential_engine<UINT, a, c, m>& urng, unsigned long long n)
+{
+  static_assert(m > 0 && m <= 0xFFFFFFFFull, "skipAhead: modulus must fit in 32 bits");
+  if (n == 0)
+    return;
+  // the engine returns its state, so one draw exposes it
+  unsigned long long x = urng();
+  --n;
+  unsigned long long mulAcc = 1, addAcc = 0;  // accumulated map, x -> mulAcc * x + addAcc
+  unsigned long long mulSq = a, addSq = c;    // the map raised to the current power of 2
+  while (n > 0) {
+    if (n & 1) {
+      mulAcc = (mulAcc * mulSq) % m;
+      addAcc = (addAcc * mulSq + addSq) % m;
+    }
+    addSq = (addSq * mulSq + addSq) % m;
+    mulSq = (mulSq * mulSq) % m;
+    n >>= 1;
+  }
+  urng.seed(static_cast<UINT>((mulAcc * x + addAcc) % m));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Inline definitions
 
 template<typename URNG>
 NormalRng<URNG>::NormalRng(size_t dimension, double mean, double stdev, URNG const & urng)
-  : dim_(dimension), urng_(urng)
+  : dim_(dimension), urng_(urng), mean_(mean), stdev_(stdev)
 {
   ORF_ASSERT(stdev > 0.0, "the standard deviation must be positive!");
-  normcdf_ = std::normal_distribution<double>(mean, stdev);
 }
 
 template<typename URNG>
@@ -62,12 +122,57 @@ size_t NormalRng<URNG>::dim() const
   return dim_;
 }
 
+template<typename URNG>
+inline double NormalRng<URNG>::uniform()
+{
+  // shift by half a tick so that neither 0 nor 1 can be returned
+  double range = double(URNG::max() - URNG::min()) + 1.0;
+  return (double(urng_() - URNG::min()) + 0.5) / range;
+}
+
 template<typename URNG>
 template <typename ITER>
 void NormalRng<URNG>::next(ITER begin, ITER end)
 {
-  for (ITER it = begin; it != end; ++it)
-    *it = normcdf_(urng_);
+  double* x = &*begin;
+  size_t n = static_cast<size_t>(end - begin);
+  for (size_t i = 0; i < n; ++i)
+    x[i] = uniform();
+  normalInvCdfInPlace(x, n);
+  if (mean_ != 0.0 || stdev_ != 1.0) {
+    for (size_t i = 0; i < n; ++i)
+      x[i] = mean_ + stdev_ * x[i];
+  }
+}
+
+template<typename URNG>
+void NormalRng<URNG>::nextBlock(size_t n, double* out, size_t ld)
+{
+  for (size_t p = 0; p < n; ++p)
+    for (size_t k = 0; k < dim_; ++k)
+      out[k * ld + p] = uniform();
+  for (size_t k = 0; k < dim_; ++k) {
+    double* x = out + k * ld;
+    normalInvCdfInPlace(x, n);
+    if (mean_ != 0.0 || stdev_ != 1.0) {
+      for (size_t p = 0; p < n; ++p)
+        x[p] = mean_ + stdev_ * x[p];
+    }
+  }
+}
+
+template<typename URNG>
+void NormalRng<URNG>::discard(unsigned long long n)
+{
+  // every deviate consumes exactly one uniform draw
+  if (n > 0)
+    skipAhead(urng_, n);
+}
+
+template<typename URNG>
+void NormalRng<URNG>::seed(unsigned long s)
+{
+  urng_.seed(static_cast<typename URNG::result_type>(s));
 }
 
 template<typename URNG>
@@ -79,20 +184,49 @@ URNG & NormalRng<URNG>::urng()
 template<>
 inline
 NormalRng<SobolURng>::NormalRng(size_t dimension, double mean, double stdev, SobolURng const& urng)
-: dim_(dimension), urng_(dimension)
+: dim_(dimension), urng_(dimension), mean_(mean), stdev_(stdev)
 {
   ORF_ASSERT(stdev > 0.0, "the standard deviation must be positive!");
-  normcdf_ = std::normal_distribution<double>(mean, stdev);
 }
 
+/** The Sobol numbers are mapped to normal deviates by inversion, over the whole point at once.
+    CAUTION: ITER must point to contiguous storage.
+*/
 template<>
 template <typename ITER>
 void NormalRng<SobolURng>::next(ITER begin, ITER end)
 {
   urng_.next(begin, end);
-  orf::NormalDistribution stdnorm;
-  for (ITER it = begin; it != end; ++it)
-    *it = stdnorm.invcdf(*it);
+  normalInvCdfInPlace(&*begin, static_cast<size_t>(end - begin));
+}
+
+/** The Sobol points are generated as one block and mapped to normal deviates one dimension at a time */
+template<>
+inline
+void NormalRng<SobolURng>::nextBlock(size_t n, double* out, size_t ld)
+{
+  urng_.nextBlock(n, out, ld);
+  if (ld == n)
+    normalInvCdfInPlace(out, n * dim_);
+  else {
+    for (size_t k = 0; k < dim_; ++k)
+      normalInvCdfInPlace(out + k * ld, n);
+  }
+}
+
+template<>
+inline
+void NormalRng<SobolURng>::discard(unsigned long long n)
+{
+  urng_.discard(n);
+}
+
+/** The seed selects the scrambling of the Sobol sequence, see SobolURng::seed() */
+template<>
+inline
+void NormalRng<SobolURng>::seed(unsigned long s)
+{
+  urng_.seed(s);
 }
 
 END_NAMESPACE(orf)
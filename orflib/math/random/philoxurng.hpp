@@ -0,0 +1,125 @@
+/**
+@file  philoxurng.hpp
+@brief Counter-based Philox4x32-10 random number generator
+*/
+
+#ifndef ORF_PHILOXURNG_HPP
+#define ORF_PHILOXURNG_HPP
+
+#include <orflib/defines.hpp>
+#include <cstdint>
+
+BEGIN_NAMESPACE(orf)
+
+/** The Philox4x32-10 counter-based generator of J. K. Salmon, M. A. Moraes, R. O. Dror
+    and D. E. Shaw, "Parallel random numbers: as easy as 1, 2, 3", SC11 (2011).
+    The n-th number of the stream is word n % 4 of the bijection of the counter n / 4
+    keyed with the seed, so it is a pure function of the seed and n: discard() costs
+    the same for any n, and a parallel run draws exactly the numbers of a serial run.
+    It satisfies the std uniform random bit generator requirements.
+*/
+class PhiloxURng
+{
+public:
+  /** Required for compatibility with std generators */
+  using result_type = uint32_t;
+
+  /** Initializing ctor */
+  explicit PhiloxURng(unsigned long long seed = 0);
+
+  static constexpr result_type min() { return 0; }
+
+  static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+  /** Returns the next number of the stream */
+  result_type operator()();
+
+  /** Restarts the stream with the passed-in seed */
+  void seed(unsigned long long s = 0);
+
+  /** Skips the next n numbers, in constant time */
+  void discard(unsigned long long n);
+
+  /** Returns in out the four numbers of block ctr of the stream with key seed */
+  static void block(unsigned long long seed, unsigned long long ctr, result_type out[4]);
+
+private:
+  unsigned long long key_;  // the seed, as the two key words
+  unsigned long long ctr_;  // the counter of the next block
+  result_type buf_[4];      // the current block
+  unsigned idx_;            // the next word of the current block, 4 if none is left
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+inline
+PhiloxURng::PhiloxURng(unsigned long long seed)
+{
+  this->seed(seed);
+}
+
+inline
+void PhiloxURng::seed(unsigned long long s)
+{
+  key_ = s;
+  ctr_ = 0;
+  idx_ = 4;
+}
+
+inline
+void PhiloxURng::block(unsigned long long seed, unsigned long long ctr, result_type out[4])
+{
+  const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;   // the round multipliers
+  const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;   // the Weyl key increments
+  uint32_t k0 = static_cast<uint32_t>(seed), k1 = static_cast<uint32_t>(seed >> 32);
+  uint32_t c0 = static_cast<uint32_t>(ctr), c1 = static_cast<uint32_t>(ctr >> 32), c2 = 0, c3 = 0;
+  for (int r = 0; r < 10; ++r) {
+    uint64_t p0 = static_cast<uint64_t>(M0) * c0;
+    uint64_t p1 = static_cast<uint64_t>(M1) * c2;
+    uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+    uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += W0;
+    k1 += W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+inline
+PhiloxURng::result_type PhiloxURng::operator()()
+{
+  if (idx_ == 4) {
+    block(key_, ctr_++, buf_);
+    idx_ = 0;
+  }
+  return buf_[idx_++];
+}
+
+inline
+void PhiloxURng::discard(unsigned long long n)
+{
+  unsigned long long left = 4 - idx_;   // words left in the current block
+  if (n <= left) {
+    idx_ += static_cast<unsigned>(n);
+    return;
+  }
+  n -= left;
+  ctr_ += n / 4;
+  idx_ = 4;
+  unsigned rem = static_cast<unsigned>(n % 4);
+  if (rem > 0) {
+    block(key_, ctr_++, buf_);
+    idx_ = rem;
+  }
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_PHILOXURNG_HPP
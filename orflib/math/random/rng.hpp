@@ -8,6 +8,7 @@
 
 #include <orflib/math/random/normalrng.hpp>
 #include <orflib/math/random/sobolurng.hpp>
+#include <orflib/math/random/philoxurng.hpp>
 
 BEGIN_NAMESPACE(orf)
 
@@ -23,6 +24,9 @@ using NormalRngRanLux3 = NormalRng<std::ranlux24>;
 /** RanLux level 4 */
 using NormalRngRanLux4 = NormalRng<std::ranlux48>;
 
+/** Philox4x32-10, counter-based */
+using NormalRngPhilox = NormalRng<orf::PhiloxURng>;
+
 /** Sobol */
 using NormalRngSobol = NormalRng<orf::SobolURng>;
 
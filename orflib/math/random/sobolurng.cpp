@@ -4,94 +4,118 @@
 */
 
 #include <orflib/math/random/sobolurng.hpp>
-#include <orflib/math/random/primitivepolynomials.hpp>
-#include <cstddef>
+#include <orflib/math/random/joekuodirectionnumbers.hpp>
+#include <random>
 
 BEGIN_NAMESPACE(orf)
 
-long SobolURng::polyInit(long dimension)
+void SobolURng::init()
 {
-  ORF_ASSERT(dimension <= MAX_PRIMITIVEPOLY, "too many dimensions in Sobol URNG");
+  ORF_ASSERT(dim_ <= MAX_SOBOLDIM, "too many dimensions in Sobol URNG");
 
-  long dimCount = 1;
-  long degCount = 1;
-  long curCount = 0;
+  // allocate the matrix of the direction numbers, MAXBIT rows of dim_ columns
+  iv.assign(dim_ * MAXBIT, 0);
 
-  while (dimCount <= dimension && degCount <= MAX_PRIMITIVEDEGREE) {
-    if (PrimitivePolynomials[degCount - 1][curCount] < 0) {
-      ++degCount;
-      curCount = 0;
-    }
+  // the first dimension has all its initial values equal to 1
+  for (size_t j = 0; j < MAXBIT; ++j)
+    iv[j * dim_] = 1ULL << (MAXBIT - j - 1);
+
+  // the other dimensions read their polynomial and initial values from the table,
+  // one line per dimension, and fill the rest with the recurrence of the polynomial
+  unsigned int const* line = JoeKuoDirectionNumbers;
+  for (size_t k = 1; k < dim_; ++k) {
+    size_t poldeg = line[0];
+    unsigned int pol = line[1];
+    unsigned int const* m = line + 2;
 
-    otpol[dimCount - 1] = PrimitivePolynomials[degCount - 1][curCount];
-    deg[dimCount - 1] = degCount;
+    for (size_t j = 0; j < poldeg; ++j)
+      iv[j * dim_ + k] = static_cast<uint64_t>(m[j]) << (MAXBIT - j - 1);
 
-    // loop
-    ++curCount;
-    ++dimCount;
+    for (size_t j = poldeg; j < MAXBIT; ++j) {
+      uint64_t i = iv[(j - poldeg) * dim_ + k];
+      i ^= (i >> poldeg);
+      for (size_t l = 1; l < poldeg; ++l) {
+        if ((pol >> (poldeg - 1 - l)) & 1)
+          i ^= iv[(j - l) * dim_ + k];
+      }
+      iv[j * dim_ + k] = i;
+    }
+    line += 2 + poldeg;
   }
-  return degCount;
 }
 
-
-long SobolURng::ivInit(long dimension)
+void SobolURng::scramble(unsigned long seed)
 {
-  // initialize the polynomials
-  long maxdeg = polyInit(dimension);
-
-  if (!maxdeg)
-    return 0;
-
-  // allocate the vector of the initial values
-  iv = (long*)calloc(dimension * MAXBIT, sizeof(long));
-  if (iv == NULL)
-    return 0;
-
-  // loop over bits up to maxdeg and for each dimension set the initial values
-  long lim = 2;
-  for (long j = 0; j < maxdeg; ++j) {
-    long val = 1;
-    for (long k = 0; k < dimension; ++k) {
-      val += 2;  // val ranges over the odd numbers
-      iv[dimension * j + k] = val % lim;
+  std::mt19937_64 gen(seed);
+  uint64_t const mask = (1ULL << MAXBIT) - 1;
+  std::vector<uint64_t> column(MAXBIT);
+  for (size_t k = 0; k < dim_; ++k) {
+    // a random lower triangular matrix with unit diagonal, acting on the binary digits
+    // of the direction numbers, most significant first; column[b] is its column for bit b
+    for (size_t b = 0; b < MAXBIT; ++b)
+      column[b] = (gen() & ((1ULL << b) - 1)) | (1ULL << b);
+
+    for (size_t j = 0; j < MAXBIT; ++j) {
+      uint64_t v = iv[j * dim_ + k];
+      uint64_t w = 0;
+      for (size_t b = 0; v != 0; ++b, v >>= 1) {
+        if (v & 1)
+          w ^= column[b];
+      }
+      iv[j * dim_ + k] = w;
     }
-    lim <<= 1;  // times 2
+    shift[k] = gen() & mask;
   }
-  return maxdeg;
 }
 
-
-void SobolURng::init(size_t dimension)
+void SobolURng::seed(unsigned long x0)
 {
-  // initialize polynomials and initial values
-  long memerror = ivInit((long) dimension);
-  if (!memerror) return;
-
-  // set vector iu to provide 2D access into iv
-  for (size_t j = 0, k = 0; j < MAXBIT; j++, k += dimension)
-    iu[j] = &iv[k];
-
-  for (size_t k = 0; k < dimension; k++) {
-    long poldeg = deg[k];
-
-    for (size_t j = 0; j < (size_t) poldeg; j++)
-      iu[j][k] <<= (MAXBIT - j -1);
-
-    for (size_t j = poldeg; j < MAXBIT; j++) {
-      long ipp = otpol[k];
-      long i = iu[j - poldeg][k];
-      i ^= (i >> poldeg);
+  init();
+  if (x0 == 0) {
+    shift.assign(dim_, 0);
+    offset = 0.0;
+    first = 1;   // skip the origin
+  }
+  else {
+    scramble(x0);
+    offset = 0.5;
+    first = 0;
+  }
+  skipTo(0);
+}
 
-      for (ptrdiff_t l = poldeg - 1; l >= 1; l--) {
-        if (ipp & 1) i ^= iu[j - l][k];
-        ipp >>= 1;
-      }
-      iu[j][k] = i;
+void SobolURng::nextBlock(size_t npoints, double* out, size_t ld)
+{
+  ORF_ASSERT(curridx_ == dim_, "SobolURng::nextBlock(), the current point is not finished");
+  ORF_ASSERT(ld >= npoints, "SobolURng::nextBlock(), the leading dimension is too small");
+
+  // the Gray code flips the same row of direction numbers in all dimensions:
+  // the row of the lowest zero bit of the index
+  flips.resize(npoints);
+  for (size_t p = 0; p < npoints; ++p) {
+    uint64_t im = in + p;
+    size_t j;
+    for (j = 0; j < MAXBIT; ++j) {
+      if (!(im & 1)) break;
+      im >>= 1;
     }
+    ORF_ASSERT(j < MAXBIT, "SobolURng: the sequence is exhausted!");
+    flips[p] = j * dim_;
   }
 
-  // the otpol and deg vectors are not needed any more
-  // we could reclaim their storage.
+  // then run the recurrence one dimension at a time, down a column of the output
+  for (size_t k = 0; k < dim_; ++k) {
+    uint64_t x = ix[k];
+    uint64_t const* v = &iv[k];
+    double* col = out + k * ld;
+    for (size_t p = 0; p < npoints; ++p) {
+      // the components have at most 52 bits, so the signed conversion is exact
+      col[p] = (static_cast<double>(static_cast<int64_t>(x)) + offset) * fac;
+      x ^= v[flips[p]];
+    }
+    ix[k] = x;
+  }
+  in += npoints;
 }
 
 END_NAMESPACE(orf)
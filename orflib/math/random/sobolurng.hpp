@@ -9,12 +9,22 @@
 
 #include <orflib/defines.hpp>
 #include <orflib/exception.hpp>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 
 
 BEGIN_NAMESPACE(orf)
 
 /** Generator of a Sobol low discrepancy sequence.
+    The direction numbers are those of Joe and Kuo, for up to 21201 dimensions.
+    The points are indexed with 64 bits and have 52 bits of resolution.
+
+    The sequence can be randomized with seed(): a random linear matrix scrambling
+    of the direction numbers followed by a random digital shift (Matousek's variant
+    of Owen's scrambling). Every randomized sequence keeps the low discrepancy of the
+    plain one, and sequences with different seeds are independent replications
+    whose spread gives the randomized quasi-Monte Carlo error.
 */
 class SobolURng
 {
@@ -24,24 +34,29 @@ public:
   /** Required for compatibility with std generators */
   using result_type = double;
 
-  /** Initializing ctor */
-  explicit SobolURng(size_t dimension);
+  /** Initializing ctor; see seed() for the meaning of the seed */
+  explicit SobolURng(size_t dimension, unsigned long seed = 0);
 
   /** Default ctor */
   SobolURng() : SobolURng(1) {};
 
-  /** Dtor */
-  ~SobolURng();
-
   /** Returns the dimension of the generator */
   size_t dim() const;
 
   /** Returns a batch of random deviates
-      CAUTION: it requires end - begin to be a divisor of dimension() 
+      CAUTION: it requires end - begin to be a divisor of dimension()
    */
   template <typename ITER>
   void next(ITER begin, ITER end);
 
+  /** Returns the next npoints points in column-major (point, dimension) layout:
+      component k of point p is written to out[k * ld + p], with ld >= npoints.
+      The points are the same as those of npoints calls to next() over a whole point,
+      but are built one dimension at a time, with contiguous writes and no copies.
+      CAUTION: the generator must not be in the middle of a point
+  */
+  void nextBlock(size_t npoints, double* out, size_t ld);
+
   /** Returns the next Sobol number.
       This method is provided to make SobolURng compatible with the URNGs in std.
       It should be called exactly dim() times to get one Sobol point (vector).
@@ -52,42 +67,56 @@ public:
 
   double max() { return 1.0; }
 
-  /** A Sobol generator cannot be seeded like a pseudorandom generator.
-      This is for compatibility with URNGs.
-      */
-  void seed(unsigned long x0 = 0) {};
+  /** Restarts the sequence, randomized with the passed-in seed.
+      Seed 0 gives the plain Sobol sequence, which starts at the point of index 1
+      since the point of index 0 is the origin. Any other seed gives a scrambled
+      sequence, which starts at the point of index 0 and has all its numbers
+      in the middle of their 2^-52 interval, so that 0 is never returned.
+  */
+  void seed(unsigned long x0 = 0);
+
+  /** Skips the next n numbers, i.e. n components of the sequence points.
+      The Gray code state of the target point is computed directly,
+      so the cost does not depend on n.
+  */
+  void discard(unsigned long long n);
+
+  /** Moves to the n-th point of the sequence, counting from 0 for the first point
+      after construction or seed(), in O(log(n)) operations.
+      Used to give each thread its own part of the sequence.
+  */
+  void skipTo(unsigned long long n);
 
 protected:
 
-  /** Method with the initializing logic */
-  void init(size_t dimension);
+  /** Initializes the direction numbers */
+  void init();
 
-private:
-  // no copy ctor or assignment op 
-  SobolURng(SobolURng const&) = delete;
-  SobolURng& operator=(SobolURng const&) = delete;
+  /** Applies a random linear matrix scrambling to the direction numbers
+      and draws a random digital shift
+  */
+  void scramble(unsigned long seed);
 
+private:
   // state
-  enum { MAXBIT = 30 };
+  enum { MAXBIT = 52 };
 
   size_t  dim_;               // the number of dimensions
   std::vector<double> point_; // the Sobol point in dim_ dimensions
   size_t curridx_;            // the current index in the point_ vector
 
-  //	long*	pol;
-  std::vector<long> otpol;  // vector with the polynomial encodings
-  std::vector<long> deg;    // vector with the corresponding polynomial degrees
-  long*	iv;                 // MAXBIT * ndim matrix of integer values
-  long	in;
-  std::vector<long>	ix;     // the vector of components
-  std::vector<long*>	iu;   // allows 2D access into iv
-  double	fac;              // the 1/2^MAXBIT normalizing factor
+  std::vector<uint64_t> iv;     // MAXBIT * ndim matrix of direction numbers
+  std::vector<uint64_t> shift;  // the digital shift of each dimension, 0 if not scrambled
+  uint64_t in;                  // the index of the point held in ix
+  uint64_t first;               // the index of the first point: 1 if plain, 0 if scrambled
+  std::vector<uint64_t> ix;     // the vector of components
+  double fac;                   // the 1/2^MAXBIT normalizing factor
+  double offset;                // added to the components: 0.5 if scrambled, else 0
+  std::vector<size_t> flips;    // scratch array, the row of iv flipped after each point of a block
 
   // helper methods
-  /** Initializes the primitive polynomials */
-  long polyInit(long dimension);
-  /** Initializes direction numbers */
-  long ivInit(long dimension);
+  /** Sets the state to the point of index n */
+  void setIndex(uint64_t n);
   /** creates the next sequence point */
   void nextPoint();
 };
@@ -96,19 +125,12 @@ private:
 // Inline definitions
 
 inline
-SobolURng::SobolURng(size_t dimension)
+SobolURng::SobolURng(size_t dimension, unsigned long seed)
 : dim_(dimension), point_(dimension), curridx_(dimension),
-otpol(dimension), deg(dimension), ix(dimension), iu(MAXBIT), in(0), fac(1.00 / (1L << MAXBIT))
+shift(dimension, 0), in(0), first(1), ix(dimension), fac(1.0 / (1ULL << MAXBIT)), offset(0.0)
 {
   ORF_ASSERT(dimension > 0, "the dimension must be positive!");
-  init(dimension);
-}
-
-inline
-SobolURng::~SobolURng()
-{
-  free(iv);
-  iv = 0;
+  this->seed(seed);
 }
 
 inline
@@ -120,17 +142,37 @@ size_t SobolURng::dim() const
 inline
 void SobolURng::nextPoint()
 {
-  size_t im = in++;
+  for (size_t k = 0; k < dim_; ++k)
+    point_[k] = (ix[k] + offset) * fac;
+
+  // move to the next point in Gray code order: flip the direction number
+  // of the lowest zero bit of the index
+  uint64_t im = in++;
   size_t j;
   for (j = 0; j < MAXBIT; ++j) {
     if (!(im & 1)) break;
     im >>= 1;
   }
-  im = j * dim_;
+  ORF_ASSERT(j < MAXBIT, "SobolURng: the sequence is exhausted!");
+  uint64_t const* v = &iv[j * dim_];
+  for (size_t k = 0; k < dim_; ++k)
+    ix[k] ^= v[k];
+}
 
-  for (size_t k = 0; k < dim_; ++k) {
-    ix[k] ^= iv[im + k];
-    point_[k] = ix[k] * fac;
+inline
+void SobolURng::setIndex(uint64_t n)
+{
+  in = n;
+  // the point of index n is the xor of the direction numbers
+  // selected by the bits of the Gray code of n
+  uint64_t gray = n ^ (n >> 1);
+  for (size_t k = 0; k < dim_; ++k)
+    ix[k] = shift[k];
+  for (size_t j = 0; gray != 0; ++j, gray >>= 1) {
+    if (gray & 1) {
+      for (size_t k = 0; k < dim_; ++k)
+        ix[k] ^= iv[j * dim_ + k];
+    }
   }
 }
 
@@ -138,9 +180,7 @@ template <typename ITER>
 inline
 void SobolURng::next(ITER begin, ITER end)
 {
-  size_t ncomp = 0;
-  for (auto it = begin; it != end; ++it)
-    ncomp++;
+  size_t ncomp = static_cast<size_t>(std::distance(begin, end));
   ORF_ASSERT(ncomp <= dim_, "SobolURng::next(), size of range to fill is too large");
   ORF_ASSERT( dim_ % ncomp == 0, "SobolURng::next(), size of range to fill is not a divisor of dim")
 
@@ -153,6 +193,31 @@ void SobolURng::next(ITER begin, ITER end)
   }
 }
 
+inline
+void SobolURng::discard(unsigned long long n)
+{
+  // components left in the current point
+  unsigned long long left = dim_ - curridx_;
+  if (n < left) {
+    curridx_ += n;
+    return;
+  }
+  n -= left;
+  skipTo(in - first + n / dim_);
+  size_t rem = static_cast<size_t>(n % dim_);
+  if (rem > 0) {
+    nextPoint();
+    curridx_ = rem;
+  }
+}
+
+inline
+void SobolURng::skipTo(unsigned long long n)
+{
+  setIndex(first + n);
+  curridx_ = dim_;
+}
+
 inline
 double SobolURng::operator()()
 {
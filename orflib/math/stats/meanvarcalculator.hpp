@@ -15,6 +15,7 @@ BEGIN_NAMESPACE(orf)
 template <typename ITER>
 class MeanVarCalculator : public StatisticsCalculator < ITER >
 {
+protected:
   using StatisticsCalculator<ITER>::nVariables;
   using StatisticsCalculator<ITER>::nsamples_;
   using StatisticsCalculator<ITER>::results_;
@@ -27,10 +28,16 @@ public:
 
   virtual void addSample(ITER begin, ITER end) override;
 
+  virtual void addSamples(ITER begin, size_t nsamples) override;
+
   virtual void reset() override;
 
   virtual Matrix const & results() override;
 
+  virtual std::shared_ptr<StatisticsCalculator<ITER>> clone() const override;
+
+  virtual void merge(StatisticsCalculator<ITER> const& other) override;
+
 protected:
 
   // state
@@ -65,6 +72,21 @@ void MeanVarCalculator<ITER>::addSample(ITER begin, ITER end)
   ++nsamples_;
 }
 
+template <typename ITER>
+void MeanVarCalculator<ITER>::addSamples(ITER begin, size_t nsamples)
+{
+  size_t nvars = runningSum_.n_elem;
+  ITER it = begin;
+  for (size_t k = 0; k < nsamples; ++k) {
+    for (size_t j = 0; j < nvars; ++j, ++it) {
+      runningSum_(j) += *it;
+      runningSum2_(j) += (*it) * (*it);
+    }
+  }
+
+  nsamples_ += nsamples;
+}
+
 template <typename ITER>
 Matrix const & MeanVarCalculator<ITER>::results()
 {
@@ -79,6 +101,25 @@ Matrix const & MeanVarCalculator<ITER>::results()
   return results_;
 }
 
+template <typename ITER>
+std::shared_ptr<StatisticsCalculator<ITER>> MeanVarCalculator<ITER>::clone() const
+{
+  return std::shared_ptr<StatisticsCalculator<ITER>>(new MeanVarCalculator<ITER>(*this));
+}
+
+template <typename ITER>
+void MeanVarCalculator<ITER>::merge(StatisticsCalculator<ITER> const& other)
+{
+  MeanVarCalculator<ITER> const* that = dynamic_cast<MeanVarCalculator<ITER> const*>(&other);
+  ORF_ASSERT(that != nullptr, "MeanVarCalculator: can only merge with another MeanVarCalculator!");
+  ORF_ASSERT(that->nVariables() == nVariables(), "MeanVarCalculator: cannot merge, different number of variables!");
+  for (size_t j = 0; j < nVariables(); ++j) {
+    runningSum_(j) += that->runningSum_(j);
+    runningSum2_(j) += that->runningSum2_(j);
+  }
+  nsamples_ += that->nsamples_;
+}
+
 template <typename ITER>
 void MeanVarCalculator<ITER>::reset()
 {
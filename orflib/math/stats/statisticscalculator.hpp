@@ -9,6 +9,7 @@
 #include <orflib/defines.hpp>
 #include <orflib/exception.hpp>
 #include <orflib/math/matrix.hpp>
+#include <memory>
 
 BEGIN_NAMESPACE(orf)
 
@@ -25,6 +26,12 @@ public:
   /** Adds one sample; requires end - big == nVariables() */
   virtual void addSample(ITER begin, ITER end) = 0;
 
+  /** Adds nsamples samples stored one after the other, nVariables() values each, from begin on;
+      ITER must be a random access iterator. Calculators override it with a loop that makes no
+      virtual calls; the default calls addSample for each sample.
+  */
+  virtual void addSamples(ITER begin, size_t nsamples);
+
   /** Clears samples and results */
   virtual void reset();
 
@@ -37,6 +44,15 @@ public:
   /** Returns the results, one column per variable */
   virtual Matrix const & results() = 0;
 
+  /** Returns a copy of this calculator, including the samples added so far */
+  virtual std::shared_ptr<StatisticsCalculator<ITER>> clone() const = 0;
+
+  /** Adds the samples collected by another calculator of the same type.
+      Merging calculators in a fixed order gives results that do not depend
+      on how the samples were split among them.
+  */
+  virtual void merge(StatisticsCalculator<ITER> const& other) = 0;
+
 protected:
 
   // state
@@ -71,9 +87,18 @@ size_t StatisticsCalculator<ITER>::nVariables() const
   return results_.n_cols;
 }
 
+template <typename ITER>
+void StatisticsCalculator<ITER>::addSamples(ITER begin, size_t nsamples)
+{
+  size_t nvars = nVariables();
+  for (size_t k = 0; k < nsamples; ++k, begin += nvars)
+    addSample(begin, begin + nvars);
+}
+
 template <typename ITER>
 void StatisticsCalculator<ITER>::reset()
 {
+  nsamples_ = 0;
   for (size_t i = 0; i < results_.n_rows; ++i) {
     for (size_t j = 0; j < results_.n_cols; ++j) {
       results_(i, j) = 0.0;
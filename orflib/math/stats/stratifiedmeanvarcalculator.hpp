@@ -0,0 +1,187 @@
+/**
+@file  stratifiedmeanvarcalculator.hpp
+@brief Calculates the mean and variance of a set of stratified samples
+*/
+
+#ifndef ORF_STRATIFIEDMEANVARCALCULATOR_HPP
+#define ORF_STRATIFIEDMEANVARCALCULATOR_HPP
+
+#include <orflib/math/stats/meanvarcalculator.hpp>
+
+BEGIN_NAMESPACE(orf)
+
+/** Mean and variance of stratified samples, which come in groups of groupSize consecutive
+    samples with one sample per stratum, e.g. the paths of one batch of a stratified simulation.
+    The samples of a group are not independent, but the group means are: the variance in the
+    results is groupSize times the sample variance of the means of the complete groups, so that
+    results(1, j) / nSamples() is the squared standard error of the mean, as for independent samples.
+    With fewer than two complete groups, it is the variance of the samples.
+    With groupSize 1 the results are those of MeanVarCalculator.
+*/
+template <typename ITER>
+class StratifiedMeanVarCalculator : public MeanVarCalculator < ITER >
+{
+  using StatisticsCalculator<ITER>::nVariables;
+  using StatisticsCalculator<ITER>::nsamples_;
+  using StatisticsCalculator<ITER>::results_;
+
+public:
+
+  StratifiedMeanVarCalculator(size_t nvars, size_t groupSize);
+
+  virtual ~StratifiedMeanVarCalculator() {}
+
+  /** Returns the number of samples of a group */
+  size_t groupSize() const;
+
+  virtual void addSample(ITER begin, ITER end) override;
+
+  virtual void addSamples(ITER begin, size_t nsamples) override;
+
+  virtual void reset() override;
+
+  virtual Matrix const & results() override;
+
+  virtual std::shared_ptr<StatisticsCalculator<ITER>> clone() const override;
+
+  /** Adds the samples of another calculator; the incomplete group of the other one,
+      if any, continues the incomplete group of this one. Only the last of the merged
+      calculators may end in an incomplete group: once this one has an incomplete group,
+      the other one must hold no complete group and at most as many samples as are
+      missing from it, e.g. the last block of a simulation.
+  */
+  virtual void merge(StatisticsCalculator<ITER> const& other) override;
+
+protected:
+
+  // Closes the current group and adds its mean to the group statistics
+  void endGroup();
+
+  // state
+  size_t groupSize_;
+  size_t ngroups_;        // the number of complete groups
+  size_t ningroup_;       // the number of samples of the current group
+  Vector groupSum_;       // the sum of the samples of the current group
+  Vector groupMeanSum_;   // the sum of the means of the complete groups
+  Vector groupMeanSum2_;  // and of their squares
+
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+template <typename ITER>
+StratifiedMeanVarCalculator<ITER>::StratifiedMeanVarCalculator(size_t nvars, size_t groupSize)
+  : MeanVarCalculator<ITER>(nvars), groupSize_(groupSize), ngroups_(0), ningroup_(0),
+  groupSum_(nvars), groupMeanSum_(nvars), groupMeanSum2_(nvars)
+{
+  ORF_ASSERT(groupSize > 0, "StratifiedMeanVarCalculator: the group size must be positive!");
+  for (size_t j = 0; j < nvars; ++j) {
+    groupSum_(j) = groupMeanSum_(j) = groupMeanSum2_(j) = 0.0;
+  }
+}
+
+template <typename ITER>
+size_t StratifiedMeanVarCalculator<ITER>::groupSize() const
+{
+  return groupSize_;
+}
+
+template <typename ITER>
+void StratifiedMeanVarCalculator<ITER>::addSample(ITER begin, ITER end)
+{
+  MeanVarCalculator<ITER>::addSample(begin, end);
+
+  ITER it = begin;
+  for (size_t j = 0; j < nVariables(); ++j, ++it)
+    groupSum_(j) += *it;
+  if (++ningroup_ == groupSize_)
+    endGroup();
+}
+
+template <typename ITER>
+void StratifiedMeanVarCalculator<ITER>::addSamples(ITER begin, size_t nsamples)
+{
+  MeanVarCalculator<ITER>::addSamples(begin, nsamples);
+
+  size_t nvars = groupSum_.n_elem;
+  ITER it = begin;
+  for (size_t k = 0; k < nsamples; ++k) {
+    for (size_t j = 0; j < nvars; ++j, ++it)
+      groupSum_(j) += *it;
+    if (++ningroup_ == groupSize_)
+      endGroup();
+  }
+}
+
+template <typename ITER>
+void StratifiedMeanVarCalculator<ITER>::endGroup()
+{
+  for (size_t j = 0; j < nVariables(); ++j) {
+    double mean = groupSum_(j) / ningroup_;
+    groupMeanSum_(j) += mean;
+    groupMeanSum2_(j) += mean * mean;
+    groupSum_(j) = 0.0;
+  }
+  ++ngroups_;
+  ningroup_ = 0;
+}
+
+template <typename ITER>
+Matrix const & StratifiedMeanVarCalculator<ITER>::results()
+{
+  MeanVarCalculator<ITER>::results();
+  if (ngroups_ < 2)
+    return results_;
+
+  for (size_t j = 0; j < nVariables(); ++j) {
+    double mean = groupMeanSum_(j) / ngroups_;
+    double var = (groupMeanSum2_(j) / ngroups_ - mean * mean) * ngroups_ / (ngroups_ - 1);
+    results_(1, j) = groupSize_ * var;
+  }
+
+  return results_;
+}
+
+template <typename ITER>
+std::shared_ptr<StatisticsCalculator<ITER>> StratifiedMeanVarCalculator<ITER>::clone() const
+{
+  return std::shared_ptr<StatisticsCalculator<ITER>>(new StratifiedMeanVarCalculator<ITER>(*this));
+}
+
+template <typename ITER>
+void StratifiedMeanVarCalculator<ITER>::merge(StatisticsCalculator<ITER> const& other)
+{
+  StratifiedMeanVarCalculator<ITER> const* that = dynamic_cast<StratifiedMeanVarCalculator<ITER> const*>(&other);
+  ORF_ASSERT(that != nullptr, "StratifiedMeanVarCalculator: can only merge with another StratifiedMeanVarCalculator!");
+  ORF_ASSERT(that->groupSize_ == groupSize_, "StratifiedMeanVarCalculator: cannot merge, different group sizes!");
+  ORF_ASSERT(ningroup_ == 0 || (that->ngroups_ == 0 && ningroup_ + that->ningroup_ <= groupSize_),
+    "StratifiedMeanVarCalculator: cannot merge after an incomplete group!");
+  MeanVarCalculator<ITER>::merge(other);
+  for (size_t j = 0; j < nVariables(); ++j) {
+    groupMeanSum_(j) += that->groupMeanSum_(j);
+    groupMeanSum2_(j) += that->groupMeanSum2_(j);
+    groupSum_(j) += that->groupSum_(j);
+  }
+  ngroups_ += that->ngroups_;
+  ningroup_ += that->ningroup_;
+  if (ningroup_ == groupSize_)
+    endGroup();
+}
+
+template <typename ITER>
+void StratifiedMeanVarCalculator<ITER>::reset()
+{
+  MeanVarCalculator<ITER>::reset();
+  for (size_t j = 0; j < nVariables(); ++j) {
+    groupSum_(j) = 0.0;
+    groupMeanSum_(j) = 0.0;
+    groupMeanSum2_(j) = 0.0;
+  }
+  ngroups_ = 0;
+  ningroup_ = 0;
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_STRATIFIEDMEANVARCALCULATOR_HPP
@@ -0,0 +1,165 @@
+/**
+@file  vectormath.hpp
+@brief Vectorizable math kernels operating in place on arrays of doubles or floats
+*/
+
+#ifndef ORF_VECTORMATH_HPP
+#define ORF_VECTORMATH_HPP
+
+#include <orflib/defines.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+BEGIN_NAMESPACE(orf)
+
+/** Computes exp(x) in place for the n values starting at x.
+    The loop body has no branches and no calls to the C library, so that the compiler
+    can vectorize it. The argument is reduced as x = k * ln(2) + r with |r| <= ln(2)/2,
+    exp(r) is computed with a degree 12 Taylor polynomial and 2^k is built directly
+    in the exponent bits. The relative error is below 4e-16 for x in [-708, 709];
+    arguments outside this range are clamped to it.
+*/
+inline void expInPlace(double* x, size_t n)
+{
+  const double log2e = 1.4426950408889634074;
+  const double ln2hi = 6.93147180369123816490e-01;   // ln(2) split in two parts (Cody-Waite)
+  const double ln2lo = 1.90821492927058770002e-10;
+  const double shifter = 6755399441055744.0;         // 1.5 * 2^52, rounds to the nearest integer
+
+  for (size_t i = 0; i < n; ++i) {
+    double xi = x[i];
+    xi = xi < -708.0 ? -708.0 : xi;
+    xi = xi > 709.0 ? 709.0 : xi;
+    // k = round(x / ln2), still as a double, and its integer bits in the mantissa of kshift
+    double kshift = xi * log2e + shifter;
+    double k = kshift - shifter;
+    double r = (xi - k * ln2hi) - k * ln2lo;
+    // exp(r) by Horner's scheme
+    double p = 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    // 2^k: move k plus the exponent bias into the exponent field; the bits of the
+    // shifter are shifted out, which is well defined in unsigned arithmetic
+    std::uint64_t kbits;
+    std::memcpy(&kbits, &kshift, sizeof(kbits));
+    std::uint64_t twokbits = (kbits + 1023u) << 52;
+    double twok;
+    std::memcpy(&twok, &twokbits, sizeof(twok));
+    x[i] = p * twok;
+  }
+}
+
+/** Single precision version of expInPlace(double*, size_t), with twice as many values per
+    vector register. The argument is reduced as above, with ln(2) split as in Cephes, exp(r)
+    is computed with a degree 7 Taylor polynomial and 2^k is built in the float exponent bits.
+    The relative error is below 2e-7 for x in [-87, 88]; arguments outside this range are clamped to it.
+*/
+inline void expInPlace(float* x, size_t n)
+{
+  const float log2e = 1.44269504f;
+  const float ln2hi = 0.693359375f;   // ln(2) split in two parts, the first one exact in a few bits
+  const float ln2lo = -2.12194440e-4f;
+  const float shifter = 12582912.0f;  // 1.5 * 2^23, rounds to the nearest integer
+
+  for (size_t i = 0; i < n; ++i) {
+    float xi = x[i];
+    xi = xi < -87.0f ? -87.0f : xi;
+    xi = xi > 88.0f ? 88.0f : xi;
+    float kshift = xi * log2e + shifter;
+    float k = kshift - shifter;
+    float r = (xi - k * ln2hi) - k * ln2lo;
+    float p = 1.0f / 5040.0f;
+    p = p * r + 1.0f / 720.0f;
+    p = p * r + 1.0f / 120.0f;
+    p = p * r + 1.0f / 24.0f;
+    p = p * r + 1.0f / 6.0f;
+    p = p * r + 0.5f;
+    p = p * r + 1.0f;
+    p = p * r + 1.0f;
+    std::uint32_t kbits;
+    std::memcpy(&kbits, &kshift, sizeof(kbits));
+    std::uint32_t twokbits = (kbits + 127u) << 23;
+    float twok;
+    std::memcpy(&twok, &twokbits, sizeof(twok));
+    x[i] = p * twok;
+  }
+}
+
+/** Computes the inverse of the standard normal cumulative distribution in place,
+    for the n probabilities starting at p, which must all be in (0, 1).
+    Uses Wichura's algorithm AS241 (PPND16), rational approximations with a relative
+    error of about 1e-16. The central region |p - 0.5| <= 0.425, where most values fall,
+    is computed for all elements in a first loop with no branches, so that the compiler
+    can vectorize it; a second loop fixes up the tails, which need a logarithm.
+*/
+inline void normalInvCdfInPlace(double* p, size_t n)
+{
+  const size_t chunk = 64;
+  double pc[chunk];  // the probabilities of the current chunk, kept for the tails
+  for (size_t begin = 0; begin < n; begin += chunk) {
+    size_t m = n - begin < chunk ? n - begin : chunk;
+    double* x = p + begin;
+    // central region, a rational function of r = 0.180625 - q^2
+    for (size_t i = 0; i < m; ++i) {
+      pc[i] = x[i];
+      double q = pc[i] - 0.5;
+      double r = 0.180625 - q * q;
+      double num = (((((((2.5090809287301226727e+3 * r + 3.3430575583588128105e+4) * r
+        + 6.7265770927008700853e+4) * r + 4.5921953931549871457e+4) * r
+        + 1.3731693765509461125e+4) * r + 1.9715909503065514427e+3) * r
+        + 1.3314166789178437745e+2) * r + 3.3871328727963666080e+0);
+      double den = (((((((5.2264952788528545610e+3 * r + 2.8729085735721942674e+4) * r
+        + 3.9307895800092710610e+4) * r + 2.1213794301586595867e+4) * r
+        + 5.3941960214247511077e+3) * r + 6.8718700749205790830e+2) * r
+        + 4.2313330701600911252e+1) * r + 1.0);
+      x[i] = q * num / den;
+    }
+    // tails, rational functions of r = sqrt(-log(min(p, 1 - p)))
+    for (size_t i = 0; i < m; ++i) {
+      double q = pc[i] - 0.5;
+      if (q * q <= 0.180625)
+        continue;
+      double pmin = q < 0.0 ? pc[i] : 1.0 - pc[i];
+      double r = std::sqrt(-std::log(pmin));
+      double xi;
+      if (r <= 5.0) {
+        r -= 1.6;
+        xi = (((((((7.74545014278341407640e-4 * r + 2.27238449892691845833e-2) * r
+          + 2.41780725177450611770e-1) * r + 1.27045825245236838258e+0) * r
+          + 3.64784832476320460504e+0) * r + 5.76949722146069140550e+0) * r
+          + 4.63033784615654529590e+0) * r + 1.42343711074968357734e+0)
+          / (((((((1.05075007164441684324e-9 * r + 5.47593808499534494600e-4) * r
+          + 1.51986665636164571966e-2) * r + 1.48103976427480074590e-1) * r
+          + 6.89767334985100004550e-1) * r + 1.67638483018380384940e+0) * r
+          + 2.05319162663775882187e+0) * r + 1.0);
+      }
+      else {
+        r -= 5.0;
+        xi = (((((((2.01033439929228813265e-7 * r + 2.71155556874348757815e-5) * r
+          + 1.24266094738807843860e-3) * r + 2.65321895265761230930e-2) * r
+          + 2.96560571828504891230e-1) * r + 1.78482653991729133580e+0) * r
+          + 5.46378491116411436990e+0) * r + 6.65790464350110377720e+0)
+          / (((((((2.04426310338993978564e-15 * r + 1.42151175831644588870e-7) * r
+          + 1.84631831751005468180e-5) * r + 7.86869131145613259100e-4) * r
+          + 1.48753612908506148525e-2) * r + 1.36929880922735805310e-1) * r
+          + 5.99832206555887937690e-1) * r + 1.0);
+      }
+      x[i] = q < 0.0 ? -xi : xi;
+    }
+  }
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_VECTORMATH_HPP
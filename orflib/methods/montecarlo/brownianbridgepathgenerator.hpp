@@ -0,0 +1,227 @@
+/**
+@file  brownianbridgepathgenerator.hpp
+@brief Definition of Monte Carlo path generator with Brownian bridge construction
+*/
+
+#ifndef ORF_BROWNIANBRIDGEPATHGENERATOR_HPP
+#define ORF_BROWNIANBRIDGEPATHGENERATOR_HPP
+
+#include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/math/random/rng.hpp>
+
+#include <vector>
+
+BEGIN_NAMESPACE(orf)
+
+/** Creates standard normal increments with the Brownian bridge construction.
+    The first deviate of each factor fixes the Brownian motion at the last time step,
+    the next ones fill in the midpoints of the remaining intervals, coarsest first.
+    The increments have the same distribution as those of EulerPathGenerator,
+    but with a low discrepancy generator the best coordinates go to the large scale
+    moves of the path, which lowers the effective dimension of path dependent payoffs.
+    The coordinates are interleaved across the independent drivers, see nDrivers():
+    bridge step s of driver j uses coordinate s * ndrivers + j. The generator is templetized on the underlying
+    normal deviate generator.
+*/
+template <typename NRNG>
+class BrownianBridgePathGenerator : public PathGenerator
+{
+public:
+
+  /** Ctor for generating increments for correlated factors.
+      If the correlation matrix is not passed in, it assumes independent factors
+  */
+  template<typename ITER>
+  BrownianBridgePathGenerator(ITER timestepsBegin, ITER timestepsEnd, size_t nfactors,
+                              Matrix const & correlMat = Matrix(),
+                              McParams::CorrelFactorType factorType = McParams::CorrelFactorType::CHOLESKY,
+                              size_t ncommonfactors = 0);
+
+  /** Returns the dimension of the generator */
+  size_t dim() const;
+
+  /** Returns the next price path */
+  virtual void next(Matrix& pricePath) override;
+
+  /** Returns the next npaths paths in structure-of-arrays layout */
+  virtual void nextBlock(size_t npaths, Matrix& paths) override;
+
+  /** Returns a copy of this generator, in the same state */
+  virtual SPtrPathGenerator clone() const override;
+
+  /** Skips the next npaths paths */
+  virtual void discard(unsigned long npaths) override;
+
+  /** Restarts the generator with a new seed */
+  virtual void seed(unsigned long s) override;
+
+protected:
+  NRNG nrng_;
+  Vector sqrtDeltaT_;              // sqrt(T1), sqrt(T2-T1), ...
+  std::vector<size_t> bridgeIdx_;  // the time index filled in at each bridge step
+  std::vector<size_t> leftIdx_;    // one past the left neighbour of each bridge step, 0 if none
+  std::vector<size_t> rightIdx_;   // the right neighbour of each bridge step
+  Vector leftWgt_;                 // the interpolation weights of the neighbours
+  Vector rightWgt_;
+  Vector stdDev_;                  // the conditional standard deviation at each bridge step
+  Vector normalDevs_;              // scratch array, the deviates of one path
+  Vector brownian_;                // scratch array, the Brownian motion of one factor
+  Matrix blockDevs_;               // scratch array, the deviates of a block of paths
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+template <typename NRNG>
+template <typename ITER>
+inline BrownianBridgePathGenerator<NRNG>::BrownianBridgePathGenerator(ITER timestepsBegin,
+                          ITER timestepsEnd,
+                          size_t nfactors,
+                          Matrix const& correlMat,
+                          McParams::CorrelFactorType factorType,
+                          size_t ncommonfactors)
+  : PathGenerator((timestepsEnd - timestepsBegin), nfactors, correlMat, factorType, ncommonfactors),
+  nrng_(ntimesteps_ * ndrivers_, 0.0, 1.0)
+{
+  ORF_ASSERT(ntimesteps_ > 0, "no time steps!");
+  size_t n = ntimesteps_;
+  Vector times(n);
+  std::copy(timestepsBegin, timestepsEnd, times.begin());
+  ORF_ASSERT(times[0] >= 0.0, "the first time step must be non-negative!");
+  sqrtDeltaT_.resize(n);
+  sqrtDeltaT_[0] = sqrt(times[0]);
+  for (size_t i = 1; i < n; ++i) {
+    double deltaT = times[i] - times[i - 1];
+    ORF_ASSERT(deltaT > 0.0, "time steps are not unique or not in increasing order!");
+    sqrtDeltaT_[i] = sqrt(deltaT);
+  }
+  normalDevs_.resize(n * ndrivers_);
+  brownian_.resize(n);
+
+  // the bridge construction, see P. Jaeckel, Monte Carlo Methods in Finance, ch. 10.8
+  bridgeIdx_.assign(n, 0);
+  leftIdx_.assign(n, 0);
+  rightIdx_.assign(n, 0);
+  leftWgt_.zeros(n);
+  rightWgt_.zeros(n);
+  stdDev_.zeros(n);
+  std::vector<size_t> filled(n, 0);    // nonzero once the point is in the bridge
+  bridgeIdx_[0] = n - 1;
+  stdDev_[0] = sqrt(times[n - 1]);
+  filled[n - 1] = 1;
+  size_t j = 0;
+  for (size_t s = 1; s < n; ++s) {
+    while (filled[j])              // the first point still to fill in
+      ++j;
+    size_t k = j;
+    while (!filled[k])             // its right neighbour
+      ++k;
+    size_t l = j + ((k - 1 - j) >> 1);   // the midpoint in between
+    filled[l] = 1;
+    bridgeIdx_[s] = l;
+    leftIdx_[s] = j;
+    rightIdx_[s] = k;
+    double tleft = j > 0 ? times[j - 1] : 0.0;
+    leftWgt_[s] = (times[k] - times[l]) / (times[k] - tleft);
+    rightWgt_[s] = (times[l] - tleft) / (times[k] - tleft);
+    stdDev_[s] = sqrt((times[l] - tleft) * (times[k] - times[l]) / (times[k] - tleft));
+    j = k + 1;
+    if (j >= n)
+      j = 0;                       // wrap around to the next level
+  }
+}
+
+template <typename NRNG>
+inline size_t BrownianBridgePathGenerator<NRNG>::dim() const
+{
+  return nrng_.dim();
+}
+
+template <typename NRNG>
+inline void BrownianBridgePathGenerator<NRNG>::next(Matrix& pricePath)
+{
+  pricePath.set_size(ntimesteps_, ndrivers_);
+  nrng_.next(normalDevs_.begin(), normalDevs_.end());
+  for (size_t f = 0; f < ndrivers_; ++f) {
+    // build the Brownian motion of this driver
+    brownian_[ntimesteps_ - 1] = stdDev_[0] * normalDevs_[f];
+    for (size_t s = 1; s < ntimesteps_; ++s) {
+      size_t j = leftIdx_[s];
+      double w = rightWgt_[s] * brownian_[rightIdx_[s]] + stdDev_[s] * normalDevs_[s * ndrivers_ + f];
+      if (j > 0)
+        w += leftWgt_[s] * brownian_[j - 1];
+      brownian_[bridgeIdx_[s]] = w;
+    }
+    // and convert it to standard normal increments; a first step at t = 0 has none
+    pricePath(0, f) = sqrtDeltaT_[0] > 0.0 ? brownian_[0] / sqrtDeltaT_[0] : 0.0;
+    for (size_t i = 1; i < ntimesteps_; ++i)
+      pricePath(i, f) = (brownian_[i] - brownian_[i - 1]) / sqrtDeltaT_[i];
+  }
+  // finally apply the correlation factor, which leaves nfactors columns
+  correlate(pricePath);
+}
+
+template <typename NRNG>
+inline void BrownianBridgePathGenerator<NRNG>::nextBlock(size_t npaths, Matrix& paths)
+{
+  paths.set_size(npaths, ndrivers_ * ntimesteps_);
+  blockDevs_.set_size(npaths, ndrivers_ * ntimesteps_);
+  nrng_.nextBlock(npaths, blockDevs_.memptr(), npaths);
+  stratifyBlock(nrng_, blockDevs_.memptr(), npaths);
+  for (size_t f = 0; f < ndrivers_; ++f) {
+    // build the Brownian motion of this driver in its columns of the block, across all paths
+    double* w = paths.colptr(f * ntimesteps_);
+    double const* z = blockDevs_.colptr(f);
+    double* wlast = w + (ntimesteps_ - 1) * npaths;
+    for (size_t p = 0; p < npaths; ++p)
+      wlast[p] = stdDev_[0] * z[p];
+    for (size_t s = 1; s < ntimesteps_; ++s) {
+      size_t j = leftIdx_[s];
+      double* wmid = w + bridgeIdx_[s] * npaths;
+      double const* wright = w + rightIdx_[s] * npaths;
+      z = blockDevs_.colptr(s * ndrivers_ + f);
+      for (size_t p = 0; p < npaths; ++p)
+        wmid[p] = rightWgt_[s] * wright[p] + stdDev_[s] * z[p];
+      if (j > 0) {
+        double const* wleft = w + (j - 1) * npaths;
+        for (size_t p = 0; p < npaths; ++p)
+          wmid[p] += leftWgt_[s] * wleft[p];
+      }
+    }
+    // and convert it to standard normal increments in place, last time step first
+    for (size_t i = ntimesteps_ - 1; i > 0; --i) {
+      double* wi = w + i * npaths;
+      double const* wprev = wi - npaths;
+      for (size_t p = 0; p < npaths; ++p)
+        wi[p] = (wi[p] - wprev[p]) / sqrtDeltaT_[i];
+    }
+    for (size_t p = 0; p < npaths; ++p)
+      w[p] = sqrtDeltaT_[0] > 0.0 ? w[p] / sqrtDeltaT_[0] : 0.0;
+  }
+  // finally apply the correlation factor to all paths and time steps at once
+  correlateBlock(paths);
+}
+
+template <typename NRNG>
+inline SPtrPathGenerator BrownianBridgePathGenerator<NRNG>::clone() const
+{
+  return SPtrPathGenerator(new BrownianBridgePathGenerator<NRNG>(*this));
+}
+
+template <typename NRNG>
+inline void BrownianBridgePathGenerator<NRNG>::discard(unsigned long npaths)
+{
+  // each path consumes ntimesteps normal deviates per driver, and as many keys if stratified
+  nrng_.discard(npaths * devsPerPath());
+}
+
+template <typename NRNG>
+inline void BrownianBridgePathGenerator<NRNG>::seed(unsigned long s)
+{
+  nrng_.seed(s);
+  seed_ = s;
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_BROWNIANBRIDGEPATHGENERATOR_HPP
@@ -24,7 +24,9 @@ public:
   */
   template<typename ITER>
   EulerPathGenerator(ITER timestepsBegin, ITER timestepsEnd, size_t nfactors,
-                     Matrix const & correlMat = Matrix());
+                     Matrix const & correlMat = Matrix(),
+                     McParams::CorrelFactorType factorType = McParams::CorrelFactorType::CHOLESKY,
+                     size_t ncommonfactors = 0);
 
   /** Returns the dimension of the generator */
   size_t dim() const;
@@ -32,10 +34,31 @@ public:
   /** Returns the next price path */
   virtual void next(Matrix& pricePath) override;
 
+  /** Returns the next npaths paths in structure-of-arrays layout */
+  virtual void nextBlock(size_t npaths, Matrix& paths) override;
+
+  /** Returns true for a single factor without stratification, where the deviates are drawn in time order */
+  virtual bool hasIncrementalPaths() const override;
+
+  /** Returns the deviates of the next nsteps time steps of the current path */
+  virtual void nextSteps(size_t nsteps, double* devs) override;
+
+  /** Skips the rest of the current path */
+  virtual void endPath() override;
+
+  /** Returns a copy of this generator, in the same state */
+  virtual SPtrPathGenerator clone() const override;
+
+  /** Skips the next npaths paths */
+  virtual void discard(unsigned long npaths) override;
+
+  /** Restarts the generator with a new seed */
+  virtual void seed(unsigned long s) override;
+
 protected:
   NRNG nrng_;
   Vector sqrtDeltaT_;              // sqrt(T1), sqrt(T2-T1), ...
-  Vector normalDevs_;              // scratch array
+  size_t stepsDrawn_;              // the deviates drawn so far from the current incremental path
 
 };
 
@@ -47,12 +70,13 @@ template <typename ITER>
 inline EulerPathGenerator<NRNG>::EulerPathGenerator(ITER timestepsBegin,
                           ITER timestepsEnd,
                           size_t nfactors,
-                          Matrix const& correlMat)
-  : PathGenerator((timestepsEnd - timestepsBegin), nfactors, correlMat),
-  nrng_((timestepsEnd - timestepsBegin) * nfactors, 0.0, 1.0)
+                          Matrix const& correlMat,
+                          McParams::CorrelFactorType factorType,
+                          size_t ncommonfactors)
+  : PathGenerator((timestepsEnd - timestepsBegin), nfactors, correlMat, factorType, ncommonfactors),
+  nrng_(ntimesteps_ * ndrivers_, 0.0, 1.0), stepsDrawn_(0)
 {
   ORF_ASSERT(ntimesteps_ > 0, "no time steps!");
-  normalDevs_.resize(ntimesteps_);
   sqrtDeltaT_.resize(ntimesteps_);
   sqrtDeltaT_[0] = sqrt(*timestepsBegin);
   ITER it = ++timestepsBegin;
@@ -73,25 +97,72 @@ inline size_t EulerPathGenerator<NRNG>::dim() const
 template <typename NRNG>
 inline void EulerPathGenerator<NRNG>::next(Matrix& pricePath)
 {
-  pricePath.resize(ntimesteps_, nfactors_);
-  // iterate over columns; the matrix will be filled column by column
-  for (size_t j = 0; j < nfactors_; ++j) {
-    nrng_.next(normalDevs_.begin(), normalDevs_.end());
-    for (size_t i = 0; i < ntimesteps_; ++i)
-      pricePath(i, j) = normalDevs_(i);
-  }
-  // finally apply the Cholesky factor if not empty
-  if (sqrtCorrel_.n_rows != 0) {
-    for (size_t i = 0; i < ntimesteps_; ++i) {
-      for (size_t j = 0; j < nfactors_; ++j) {
-        double sum = 0.0;
-        for (size_t k = 0; k < nfactors_; ++k) {
-          sum += sqrtCorrel_(nfactors_ - j - 1, k) * pricePath(i, k);
-        }
-        pricePath(i, nfactors_ - j - 1) = sum;
-      }
-    }
-  }
+  pricePath.set_size(ntimesteps_, ndrivers_);
+  // the matrix is filled column by column, straight from the generator
+  nrng_.next(pricePath.memptr(), pricePath.memptr() + pricePath.n_elem);
+  // finally apply the correlation factor, which leaves nfactors columns
+  correlate(pricePath);
+}
+
+template <typename NRNG>
+inline void EulerPathGenerator<NRNG>::nextBlock(size_t npaths, Matrix& paths)
+{
+  paths.set_size(npaths, ndrivers_ * ntimesteps_);
+  // each path takes the next dim() deviates of the stream, driver by driver,
+  // which the generator writes straight into the rows of the block
+  nrng_.nextBlock(npaths, paths.memptr(), npaths);
+  // the increments have no terminal value to stratify on their own
+  ORF_ASSERT(stratification_ != McParams::StratificationType::TERMINAL,
+    "EulerPathGenerator: terminal stratification needs the Brownian bridge!");
+  stratifyBlock(nrng_, paths.memptr(), npaths);
+  // apply the correlation factor to all paths and time steps at once
+  correlateBlock(paths);
+}
+
+template <typename NRNG>
+inline bool EulerPathGenerator<NRNG>::hasIncrementalPaths() const
+{
+  return ndrivers_ == 1 && stratification_ == McParams::StratificationType::NONE;
+}
+
+template <typename NRNG>
+inline void EulerPathGenerator<NRNG>::nextSteps(size_t nsteps, double* devs)
+{
+  ORF_ASSERT(ndrivers_ == 1, "incremental paths need a single factor!");
+  ORF_ASSERT(stepsDrawn_ + nsteps <= ntimesteps_, "too many time steps requested!");
+  // one deviate at a time, as a low discrepancy generator fills whole divisors of its dimension
+  for (size_t i = 0; i < nsteps; ++i)
+    nrng_.next(devs + i, devs + i + 1);
+  stepsDrawn_ += nsteps;
+}
+
+template <typename NRNG>
+inline void EulerPathGenerator<NRNG>::endPath()
+{
+  if (stepsDrawn_ < ntimesteps_)
+    nrng_.discard(ntimesteps_ - stepsDrawn_);
+  stepsDrawn_ = 0;
+}
+
+template <typename NRNG>
+inline SPtrPathGenerator EulerPathGenerator<NRNG>::clone() const
+{
+  return SPtrPathGenerator(new EulerPathGenerator<NRNG>(*this));
+}
+
+template <typename NRNG>
+inline void EulerPathGenerator<NRNG>::discard(unsigned long npaths)
+{
+  // each path consumes ntimesteps normal deviates per driver, and as many keys if stratified
+  nrng_.discard(npaths * devsPerPath());
+}
+
+template <typename NRNG>
+inline void EulerPathGenerator<NRNG>::seed(unsigned long s)
+{
+  nrng_.seed(s);
+  seed_ = s;
+  stepsDrawn_ = 0;
 }
 
 END_NAMESPACE(orf)
@@ -0,0 +1,45 @@
+/**
+@file  gbmsteps.cpp
+@brief Implementation of the GbmSteps class
+*/
+
+#include <orflib/methods/montecarlo/gbmsteps.hpp>
+
+#include <cmath>
+
+BEGIN_NAMESPACE(orf)
+
+GbmSteps::GbmSteps(Vector const& times,
+                   SPtrYieldCurve discountCurve,
+                   double divYield,
+                   SPtrVolatilityTermStructure volatility)
+{
+  ORF_ASSERT(discountCurve, "GbmSteps: no discount curve!");
+  ORF_ASSERT(volatility, "GbmSteps: no volatility!");
+  size_t nsteps = times.n_elem;
+  drifts_.resize(nsteps);
+  stdevs_.resize(nsteps);
+  sqrtdts_.resize(nsteps);
+  volDerivs_.resize(nsteps);
+  double t1 = 0.0;
+  for (size_t i = 0; i < nsteps; ++i) {
+    double t2 = times[i];
+    ORF_ASSERT(t2 >= t1, "GbmSteps: the times must be non-negative and in increasing order!");
+    double dt = t2 - t1;
+    double var = 0.0, fwdrate = 0.0;
+    if (dt > 0.0) {
+      double vol = volatility->fwdVol(t1, t2);
+      var = vol * vol * dt;
+      fwdrate = discountCurve->fwdRate(t1, t2);
+    }
+    stdevs_[i] = std::sqrt(var);
+    sqrtdts_[i] = std::sqrt(dt);
+    // a zero vol moves with the shift times sqrt(dt)
+    volDerivs_[i] = stdevs_[i] > 0.0 ? volatility->fwdVolIntegral(t1, t2) / stdevs_[i] : sqrtdts_[i];
+    // risk free rate less yield plus convexity adjustment
+    drifts_[i] = (fwdrate - divYield) * dt - 0.5 * var;
+    t1 = t2;
+  }
+}
+
+END_NAMESPACE(orf)
@@ -0,0 +1,124 @@
+/**
+@file  gbmsteps.hpp
+@brief The exact log-normal time steps of an asset in the Black-Scholes model
+*/
+
+#ifndef ORF_GBMSTEPS_HPP
+#define ORF_GBMSTEPS_HPP
+
+#include <orflib/math/matrix.hpp>
+#include <orflib/market/yieldcurve.hpp>
+#include <orflib/market/volatilitytermstructure.hpp>
+#include <orflib/math/vectormath.hpp>
+
+#include <cmath>
+
+BEGIN_NAMESPACE(orf)
+
+/** The time steps of the log spot of an asset in the Black-Scholes model, with deterministic
+    rates and vols, over a time line starting at t = 0.
+    Over step i, from t(i-1) to t(i), the log spot moves by drifts()[i] + stdevs()[i] * z,
+    z standard normal, with the forward rate, the dividend yield and the forward vol of the step:
+      drift(i) = int f(t) dt - q * dt(i) - vol(i)^2 * dt(i) / 2,  stdev(i) = vol(i) * sqrt(dt(i))
+    This is exact for any step size, also with a volatility term structure, so that the time
+    line only needs the fixing times of the products, and the paths have the forward variances
+    of the term structure, as in the PDE solvers.
+    The Monte Carlo pricers of the Black-Scholes model compute the steps of each asset once,
+    over the time line they simulate, shared by all the products they price.
+*/
+class GbmSteps
+{
+public:
+  /** Initializing ctor; the times must be non-decreasing and non-negative */
+  GbmSteps(Vector const& times,
+           SPtrYieldCurve discountCurve,
+           double divYield,
+           SPtrVolatilityTermStructure volatility);
+
+  /** Returns the number of time steps */
+  size_t nSteps() const;
+
+  /** Returns the log spot drift of each time step */
+  Vector const& drifts() const;
+
+  /** Returns the log spot standard deviation of each time step */
+  Vector const& stdevs() const;
+
+  /** Returns the square root of the length of each time step */
+  Vector const& sqrtdts() const;
+
+  /** Returns the derivative of the standard deviation of each time step with respect to
+      a parallel shift of the forward vols, int vol dt / stdev; sqrt(dt) if the vol is constant
+      over the step. It gives the vegas of the Monte Carlo pricers.
+  */
+  Vector const& volDerivs() const;
+
+private:
+  Vector drifts_;
+  Vector stdevs_;
+  Vector sqrtdts_;
+  Vector volDerivs_;
+};
+
+/** Converts the normal deviates of one asset in a block of paths to prices, in place.
+    paths holds ntimesteps columns of npaths deviates, in the layout of PathGenerator::nextBlock;
+    over time step i the log spot moves by drifts[i] + stdevs[i] * z, from log(spot) at t = 0,
+    e.g. with the steps of GbmSteps. The log spots are accumulated one time step at a time across
+    all paths and then exponentiated in one pass. See toPricesSinglePrecision for single precision.
+*/
+void toGbmPrices(double* paths, size_t npaths, size_t ntimesteps, double spot,
+                 double const* drifts, double const* stdevs);
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+inline
+size_t GbmSteps::nSteps() const
+{
+  return drifts_.n_elem;
+}
+
+inline
+Vector const& GbmSteps::drifts() const
+{
+  return drifts_;
+}
+
+inline
+Vector const& GbmSteps::stdevs() const
+{
+  return stdevs_;
+}
+
+inline
+Vector const& GbmSteps::sqrtdts() const
+{
+  return sqrtdts_;
+}
+
+inline
+Vector const& GbmSteps::volDerivs() const
+{
+  return volDerivs_;
+}
+
+inline
+void toGbmPrices(double* paths, size_t npaths, size_t ntimesteps, double spot,
+                 double const* drifts, double const* stdevs)
+{
+  double logspot = std::log(spot);
+  double* x = paths;
+  for (size_t p = 0; p < npaths; ++p)
+    x[p] = logspot + drifts[0] + stdevs[0] * x[p];
+  for (size_t i = 1; i < ntimesteps; ++i) {
+    double const* xprev = paths + (i - 1) * npaths;
+    x = paths + i * npaths;
+    for (size_t p = 0; p < npaths; ++p)
+      x[p] = xprev[p] + drifts[i] + stdevs[i] * x[p];
+  }
+  expInPlace(paths, npaths * ntimesteps);
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_GBMSTEPS_HPP
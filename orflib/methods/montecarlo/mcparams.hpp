@@ -23,13 +23,31 @@ struct McParams
     MT19937,
     RANLUX3,
     RANLUX4,
+    PHILOX,
     SOBOL
   };
 
   /** The known path generator types */
   enum class PathGenType
   {
-    EULER
+    EULER,
+    BROWNIAN_BRIDGE
+  };
+
+  /** The known factorizations of the correlation matrix */
+  enum class CorrelFactorType
+  {
+    CHOLESKY,
+    PCA,
+    FACTOR_MODEL    // nCorrelFactors common factors plus one idiosyncratic term per factor
+  };
+
+  /** The known stratifications of the normal deviates of a batch of paths, see PathGenerator::setStratification */
+  enum class StratificationType
+  {
+    NONE,
+    TERMINAL,         // the terminal value of each Brownian motion; the paths are built with the Brownian bridge
+    LATIN_HYPERCUBE   // every deviate of the path
   };
 
 
@@ -39,6 +57,20 @@ struct McParams
   // state
   UrngType urngType;
   PathGenType pathGenType;
+  CorrelFactorType correlFactorType;
+  size_t nCorrelFactors;  // number of common factors of the FACTOR_MODEL correlation
+  StratificationType stratification;  // stratify the paths of each batch, see PathGenerator::setStratification
+  size_t nThreads;        // number of worker threads; 0 means one per hardware thread
+  size_t nReplications;   // number of independent replications, see simulateReplications
+  double absTolerance;    // simulate until the standard error is at most this, see simulateMc; 0 for none
+  double relTolerance;    // likewise, relative to the absolute value of the mean; 0 for none
+  double maxSeconds;      // or until this much time has elapsed, see simulateMc; 0 for no limit
+  bool antithetic;        // each sample averages a path and its mirror image
+  bool momentMatching;    // shift the normal deviates of each batch to zero sample mean
+  bool controlVariate;    // correct each sample with the product's control variate, fit on separate pilot paths
+  bool greeks;            // also estimate delta, gamma and vega in the same simulation, see BsMcPricer
+  bool importanceSampling;  // shift the drift of the normal deviates towards the payoff, see BsMcPricer
+  bool singlePrecision;   // convert the deviates to prices in single precision, see toPricesSinglePrecision
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -46,7 +78,10 @@ struct McParams
 
 inline
 McParams::McParams(UrngType u, PathGenType p)
-: urngType(u), pathGenType(p)
+: urngType(u), pathGenType(p), correlFactorType(CorrelFactorType::CHOLESKY), nCorrelFactors(1),
+  stratification(StratificationType::NONE), nThreads(1), nReplications(1),
+  absTolerance(0.0), relTolerance(0.0), maxSeconds(0.0), antithetic(false), momentMatching(false), controlVariate(false), greeks(false),
+  importanceSampling(false), singlePrecision(false)
 {}
 
 END_NAMESPACE(orf)
@@ -0,0 +1,45 @@
+/**
+@file  momentmatching.hpp
+@brief Moment matching of a block of normal deviates
+*/
+
+#ifndef ORF_MOMENTMATCHING_HPP
+#define ORF_MOMENTMATCHING_HPP
+
+#include <orflib/defines.hpp>
+#include <orflib/math/matrix.hpp>
+
+#include <cmath>
+
+BEGIN_NAMESPACE(orf)
+
+/** Matches the first moment of each column of a block of normal deviates, as
+    returned by PathGenerator::nextBlock: z -> (z - mean) * sqrt(n / (n - 1)),
+    where n is the number of paths in the block and mean the sample mean of the column.
+    Each column then has zero sample mean, and each deviate is still exactly N(0, 1)
+    distributed, so the prices stay unbiased. Matching the sample variance as well
+    would bias prices by O(1/n), about 0.5% of an at-the-money call for 64 paths.
+    The paths of the block are negatively correlated; the standard error computed
+    as if they were independent is therefore conservative.
+    Blocks of fewer than two paths are left unchanged.
+*/
+inline void matchMoments(Matrix& paths)
+{
+  size_t npaths = paths.n_rows;
+  if (npaths < 2)
+    return;
+  double scale = std::sqrt(double(npaths) / double(npaths - 1));
+  for (size_t k = 0; k < paths.n_cols; ++k) {
+    double* z = paths.colptr(k);
+    double sum = 0.0;
+    for (size_t p = 0; p < npaths; ++p)
+      sum += z[p];
+    double mean = sum / npaths;
+    for (size_t p = 0; p < npaths; ++p)
+      z[p] = (z[p] - mean) * scale;
+  }
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_MOMENTMATCHING_HPP
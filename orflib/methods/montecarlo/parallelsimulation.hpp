@@ -0,0 +1,290 @@
+/**
+@file  parallelsimulation.hpp
+@brief Multi-threaded driver for the Monte Carlo simulation loop
+*/
+
+#ifndef ORF_PARALLELSIMULATION_HPP
+#define ORF_PARALLELSIMULATION_HPP
+
+#include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/methods/montecarlo/mcparams.hpp>
+#include <orflib/products/product.hpp>
+#include <orflib/math/stats/statisticscalculator.hpp>
+#include <orflib/math/stats/meanvarcalculator.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <thread>
+#include <vector>
+
+BEGIN_NAMESPACE(orf)
+
+/** The number of paths in one block of the parallel simulation.
+    The blocks, and not the threads, are the units that accumulate statistics.
+*/
+const unsigned long MC_PATHS_PER_BLOCK = 1024;
+
+/** The number of paths generated together in one structure-of-arrays batch.
+    It keeps the batch buffer within the processor cache for typical time lines.
+*/
+const size_t MC_PATHS_PER_BATCH = 64;
+
+/** The number of paths of the first round of a simulation to a tolerance, see simulateMc */
+const unsigned long MC_PATHS_FIRST_ROUND = 8 * MC_PATHS_PER_BLOCK;
+
+/** Returns the number of consecutive samples of a simulation with mcparams that are stratified
+    together, see StratifiedMeanVarCalculator: the paths of one batch with a stratification, else 1.
+    Replications are independent samples.
+*/
+inline size_t mcSampleGroupSize(McParams const& mcparams)
+{
+  if (mcparams.stratification == McParams::StratificationType::NONE || mcparams.nReplications > 1)
+    return 1;
+  return MC_PATHS_PER_BATCH;
+}
+
+/** Per-thread scratch buffers of the simulation.
+    They are sized by the first batch and reused by all later ones.
+*/
+struct McWorkspace
+{
+  Matrix paths;         // npaths x (nfactors * ntimesteps), see PathGenerator::nextBlock
+  Matrix mirrorPaths;   // the antithetic paths, same layout
+  Matrix pricePath;     // ntimesteps x nfactors, the path of one simulation as seen by the product
+  Vector pvs;           // the PVs of the paths in the batch, nvariables consecutive values per path
+  SPtrProduct control;  // this thread's copy of the control variate product, if any
+  Matrix controlPath;   // the block of paths as seen by the control variate
+  Vector controlPvs;    // the PVs of the control variate in the batch
+  Matrix brownians;     // ntimesteps x npaths, the Brownian motion of each path, for the Greeks
+  Matrix payDerivs;     // the derivatives of the payments with respect to the path, see Product::evalPathwise
+  Matrix deviates;      // the correlated normal deviates of the block, same layout as paths, for the Greeks
+  Vector greeks;        // the Greeks of one path
+  Vector adjoints;      // scratch array, the adjoints of intermediate results of one path
+  Vector lrWeights;     // the likelihood ratio of each path in the batch, for importance sampling
+  Vector slice;         // the spots of all assets at one fixing, see Product::observeFixing
+  Vector logSlice;      // and their logs
+  Vector blockPvs;      // the PVs of the paths of a block, see Product::evalBlock
+  std::vector<float> floatPaths;  // the log returns of a block in single precision, see McParams::singlePrecision
+  std::vector<SPtrProduct> bumpedProducts;  // this thread's copies of the products with bumped model data, if any
+  std::vector<SPtrProduct> products;        // this thread's copies of the products of a multi-product pricer
+};
+
+/** Sets mirrorPaths to the antithetic block of paths, the deviates of paths with the opposite sign */
+inline void mirrorDeviates(Matrix const& paths, Matrix& mirrorPaths)
+{
+  mirrorPaths.set_size(paths.n_rows, paths.n_cols);
+  for (size_t k = 0; k < paths.n_elem; ++k)
+    mirrorPaths[k] = -paths[k];
+}
+
+/** Runs npaths Monte Carlo paths on nthreads worker threads.
+    The paths are split into blocks of MC_PATHS_PER_BLOCK consecutive paths and
+    each thread gets a contiguous range of blocks. Every thread works on its own
+    clone of the path generator, skipped ahead to its first path, and on its own
+    clone of the product. Each block collects its samples in its own clone of the
+    statistics calculator and the blocks are merged into statsCalc in path order.
+    Hence the results are identical to a single-threaded run, whatever nthreads is.
+    On exit the path generator is positioned after the last simulated path.
+
+    processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t n)
+    must simulate the next n <= MC_PATHS_PER_BATCH paths with the passed-in generator
+    and product and store their samples in ws.pvs, the nVariables() values of path k
+    from ws.pvs[k * nVariables()] on, as StatisticsCalculator::addSamples() reads them:
+    the n samples are added to the statistics of the block in a single call.
+*/
+template <typename ITER, typename PROCESSPATHS>
+void simulateInParallel(StatisticsCalculator<ITER>& statsCalc,
+                        SPtrPathGenerator& pathgen,
+                        SPtrProduct const& prod,
+                        unsigned long npaths,
+                        size_t nthreads,
+                        PROCESSPATHS processPaths)
+{
+  if (npaths == 0)
+    return;
+  if (nthreads == 0)
+    nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  unsigned long nblocks = (npaths + MC_PATHS_PER_BLOCK - 1) / MC_PATHS_PER_BLOCK;
+  nthreads = std::min<size_t>(nthreads, nblocks);
+
+  std::vector<std::shared_ptr<StatisticsCalculator<ITER>>> blockStats(nblocks);
+  std::vector<SPtrPathGenerator> threadPathGens(nthreads);
+  std::vector<std::exception_ptr> errors(nthreads);
+
+  auto work = [&](size_t ithread) {
+    try {
+      unsigned long firstBlock = static_cast<unsigned long>(nblocks * ithread / nthreads);
+      unsigned long lastBlock = static_cast<unsigned long>(nblocks * (ithread + 1) / nthreads);
+      // independent stream: skip ahead to the first path of this thread
+      SPtrPathGenerator mypathgen = pathgen->clone();
+      mypathgen->discard(firstBlock * MC_PATHS_PER_BLOCK);
+      SPtrProduct myprod = prod->clone();
+      McWorkspace ws;
+
+      for (unsigned long b = firstBlock; b < lastBlock; ++b) {
+        std::shared_ptr<StatisticsCalculator<ITER>> sc = statsCalc.clone();
+        sc->reset();
+        unsigned long blockEnd = std::min(npaths, (b + 1) * MC_PATHS_PER_BLOCK);
+        // This is the HOT loop
+        for (unsigned long i = b * MC_PATHS_PER_BLOCK; i < blockEnd; i += MC_PATHS_PER_BATCH) {
+          size_t n = std::min<size_t>(MC_PATHS_PER_BATCH, blockEnd - i);
+          processPaths(*mypathgen, *myprod, ws, n);
+          sc->addSamples(ws.pvs.memptr(), n);
+        }
+        blockStats[b] = sc;
+      }
+      threadPathGens[ithread] = mypathgen;
+    }
+    catch (...) {
+      errors[ithread] = std::current_exception();
+    }
+  };
+
+  if (nthreads == 1)
+    work(0);
+  else {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < nthreads; ++t)
+      threads.push_back(std::thread(work, t));
+    for (auto& th : threads)
+      th.join();
+  }
+  for (auto const& err : errors) {
+    if (err)
+      std::rethrow_exception(err);
+  }
+
+  // deterministic merge, in block order
+  for (unsigned long b = 0; b < nblocks; ++b)
+    statsCalc.merge(*blockStats[b]);
+  // the last thread ends where the serial stream would end
+  pathgen = threadPathGens[nthreads - 1];
+}
+
+/** Runs npaths Monte Carlo paths as nreplications independent replications of
+    npaths / nreplications paths each (rounded up), for an error estimate with low discrepancy
+    generators. The replications start from the current state of the path generator, so that
+    they never replay paths already drawn from it, e.g. by an earlier run or a regression pass.
+    With a pseudo-random generator they are consecutive parts of its stream, the paths that
+    simulateInParallel would simulate. With a low discrepancy generator (lowDiscrepancy true)
+    replication r restarts the sequence with seed lastSeed() + r + 1, an independent scrambling,
+    and the next call continues with the seeds after those.
+    Each replication adds a single sample to statsCalc, the means of the variables over its paths,
+    so that the mean in statsCalc is the overall mean and the variance is that of the replication means.
+    With nreplications <= 1 this is simulateInParallel.
+    On exit the path generator is that of the last replication.
+*/
+template <typename ITER, typename PROCESSPATHS>
+void simulateReplications(StatisticsCalculator<ITER>& statsCalc,
+                          SPtrPathGenerator& pathgen,
+                          SPtrProduct const& prod,
+                          unsigned long npaths,
+                          size_t nreplications,
+                          bool lowDiscrepancy,
+                          size_t nthreads,
+                          PROCESSPATHS processPaths)
+{
+  if (nreplications <= 1) {
+    simulateInParallel(statsCalc, pathgen, prod, npaths, nthreads, processPaths);
+    return;
+  }
+  if (npaths == 0)
+    return;
+  size_t nvars = statsCalc.nVariables();
+  unsigned long nreppaths = static_cast<unsigned long>((npaths + nreplications - 1) / nreplications);
+
+  MeanVarCalculator<ITER> repStats(nvars);
+  Vector means(nvars);
+  SPtrPathGenerator reppathgen = pathgen->clone();
+  unsigned long seed0 = reppathgen->lastSeed();
+  for (size_t r = 0; r < nreplications; ++r) {
+    // simulateInParallel leaves reppathgen after the paths of replication r
+    if (lowDiscrepancy)
+      reppathgen->seed(seed0 + static_cast<unsigned long>(r + 1));
+    repStats.reset();
+    simulateInParallel(repStats, reppathgen, prod, nreppaths, nthreads, processPaths);
+    Matrix const& results = repStats.results();
+    for (size_t j = 0; j < nvars; ++j)
+      means[j] = results(0, j);
+    statsCalc.addSample(means.memptr(), means.memptr() + nvars);
+  }
+  pathgen = reppathgen;
+}
+
+/** What a Monte Carlo run did, see simulateMc */
+struct McRunInfo
+{
+  unsigned long npaths;   // the number of paths simulated
+  double seconds;         // the elapsed wall clock time
+  bool converged;         // true if the run stopped at the requested standard error
+};
+
+/** Runs the Monte Carlo simulation selected by mcparams.
+    Without McParams::absTolerance, relTolerance or maxSeconds, it simulates npaths paths
+    with simulateReplications. Otherwise it simulates in rounds, and checks the standard error
+    of the first variable, e.g. the price, between them. It stops as soon as the standard error
+    is at most absTolerance or relTolerance times the absolute mean, as soon as maxSeconds
+    have elapsed, or after npaths paths, whichever comes first.
+    The first round has MC_PATHS_FIRST_ROUND paths. Each later one has the paths that the
+    current standard error says are still needed, in whole blocks and at most as many as
+    were simulated so far, so that the time budget is overrun by at most one such round.
+    The round sizes depend on the samples only: unless the time budget ends the run, the
+    results do not depend on the number of threads.
+    In rounds, the statistics calculator must return the mean and the variance in its first two
+    result rows, as MeanVarCalculator does, and the run cannot be split in replications.
+*/
+template <typename ITER, typename PROCESSPATHS>
+McRunInfo simulateMc(StatisticsCalculator<ITER>& statsCalc,
+                     SPtrPathGenerator& pathgen,
+                     SPtrProduct const& prod,
+                     unsigned long npaths,
+                     McParams const& mcparams,
+                     PROCESSPATHS processPaths)
+{
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&start]() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+  McRunInfo info = { 0, 0.0, false };
+
+  if (mcparams.absTolerance <= 0.0 && mcparams.relTolerance <= 0.0 && mcparams.maxSeconds <= 0.0) {
+    simulateReplications(statsCalc, pathgen, prod, npaths, mcparams.nReplications,
+                         mcparams.urngType == McParams::UrngType::SOBOL, mcparams.nThreads, processPaths);
+    size_t nreps = std::max<size_t>(mcparams.nReplications, 1);
+    info.npaths = static_cast<unsigned long>((npaths + nreps - 1) / nreps * nreps);
+    info.seconds = elapsed();
+    return info;
+  }
+  ORF_ASSERT(mcparams.nReplications <= 1, "simulateMc: a simulation to a tolerance cannot be split in replications!");
+
+  unsigned long nround = std::min(npaths, MC_PATHS_FIRST_ROUND);
+  while (nround > 0) {
+    simulateInParallel(statsCalc, pathgen, prod, nround, mcparams.nThreads, processPaths);
+    info.npaths += nround;
+
+    Matrix const& results = statsCalc.results();
+    double stderror = std::sqrt(results(1, 0) / statsCalc.nSamples());
+    double tol = std::max(mcparams.absTolerance, mcparams.relTolerance * std::abs(results(0, 0)));
+    if (tol > 0.0 && stderror <= tol) {
+      info.converged = true;
+      break;
+    }
+    if (mcparams.maxSeconds > 0.0 && elapsed() >= mcparams.maxSeconds)
+      break;
+
+    // the standard error goes as 1 / sqrt(npaths); without a tolerance, double the paths
+    double needed = tol > 0.0 ? info.npaths * ((stderror / tol) * (stderror / tol) - 1.0) : info.npaths;
+    unsigned long next = needed < info.npaths ? static_cast<unsigned long>(needed) : info.npaths;
+    next = std::max(1ul, (next + MC_PATHS_PER_BLOCK - 1) / MC_PATHS_PER_BLOCK) * MC_PATHS_PER_BLOCK;
+    nround = std::min(next, npaths - info.npaths);
+  }
+  info.seconds = elapsed();
+  return info;
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_PARALLELSIMULATION_HPP
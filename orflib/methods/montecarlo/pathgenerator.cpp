@@ -5,16 +5,169 @@
 
 #include <orflib/methods/montecarlo/pathgenerator.hpp>
 #include <orflib/math/linalg/linalg.hpp>
+#include <orflib/math/vectormath.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
 
 BEGIN_NAMESPACE(orf)
 
-void PathGenerator::initCorrelation(Matrix const& corrMat)
+namespace {
+
+  // the top k eigenvectors of the symmetric matrix m, scaled by the square root of their
+  // eigenvalues, by decreasing eigenvalue
+  Matrix principalComponents(Matrix const& m, size_t k)
+  {
+    Vector eigvals;
+    Matrix eigvecs;
+    eigensym(m, eigvals, eigvecs);
+    size_t n = eigvals.n_elem;
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&eigvals](size_t a, size_t b) { return eigvals[a] > eigvals[b]; });
+    Matrix pcs(n, k);
+    for (size_t l = 0; l < k; ++l) {
+      double scale = std::sqrt(std::max(eigvals[order[l]], 0.0));
+      for (size_t i = 0; i < n; ++i)
+        pcs(i, l) = eigvecs(i, order[l]) * scale;
+    }
+    return pcs;
+  }
+
+} // anonymous namespace
+
+void PathGenerator::initCorrelation(Matrix const& corrMat, McParams::CorrelFactorType factorType,
+                                    size_t ncommonfactors)
 {
   if (corrMat.is_empty())
     return;               // no correlation passed, nothing to do
   Matrix fixedCorrel = corrMat;
   spectrunc(fixedCorrel);               // spectral truncation
-  choldcmp(fixedCorrel, sqrtCorrel_);   // Cholesky decomposition
+  if (factorType == McParams::CorrelFactorType::CHOLESKY)
+    choldcmp(fixedCorrel, sqrtCorrel_);   // Cholesky decomposition
+  else if (factorType == McParams::CorrelFactorType::PCA) {
+    // the first deviate drives the factor that explains most of the variance
+    sqrtCorrel_ = principalComponents(fixedCorrel, nfactors_);
+  }
+  else if (factorType == McParams::CorrelFactorType::FACTOR_MODEL) {
+    // the model z_i = sum_l B_il f_l + sqrt(1 - sum_l B_il^2) e_i, with k common factors f
+    // and independent idiosyncratic terms e, has correlation B B^T off the diagonal.
+    // The loadings B are fitted by iterated principal factors: the top k principal components
+    // of the correlation matrix with its diagonal replaced by the communalities sum_l B_il^2
+    size_t k = ncommonfactors;
+    ORF_ASSERT(k > 0 && k < nfactors_,
+               "the number of common factors must be positive and less than the number of factors!");
+    const size_t maxiter = 100;
+    const double tol = 1.0e-10;
+    Vector communality(nfactors_, arma::fill::ones);
+    Matrix reduced = fixedCorrel;
+    for (size_t iter = 0; iter < maxiter; ++iter) {
+      for (size_t i = 0; i < nfactors_; ++i)
+        reduced(i, i) = communality[i];
+      sqrtCorrel_ = principalComponents(reduced, k);
+      double change = 0.0;
+      for (size_t i = 0; i < nfactors_; ++i) {
+        double c = 0.0;
+        for (size_t l = 0; l < k; ++l)
+          c += sqrtCorrel_(i, l) * sqrtCorrel_(i, l);
+        c = std::min(c, 1.0);
+        change = std::max(change, std::abs(c - communality[i]));
+        communality[i] = c;
+      }
+      if (change < tol)
+        break;
+    }
+    // rescale the loadings so that the communalities match those used for the idiosyncratic terms
+    idioStdev_.set_size(nfactors_);
+    for (size_t i = 0; i < nfactors_; ++i) {
+      double c = 0.0;
+      for (size_t l = 0; l < k; ++l)
+        c += sqrtCorrel_(i, l) * sqrtCorrel_(i, l);
+      if (c > 1.0) {
+        for (size_t l = 0; l < k; ++l)
+          sqrtCorrel_(i, l) /= std::sqrt(c);
+        c = 1.0;
+      }
+      idioStdev_[i] = std::sqrt(1.0 - c);
+    }
+    ndrivers_ = k + nfactors_;
+  }
+  else
+    ORF_ASSERT(0, "unknown correlation factor type!");
+}
+
+void PathGenerator::correlateRows(double* devs, double* out, size_t nrows)
+{
+  // matrix views on the deviates and the output, without copies
+  Matrix z(devs, nrows, ndrivers_, false, true);
+  Matrix x(out, nrows, nfactors_, false, true);
+  if (idioStdev_.is_empty()) {
+    x = z * sqrtCorrel_.t();
+    return;
+  }
+  // the common factors are the first k columns of the deviates, the idiosyncratic terms the rest
+  size_t k = sqrtCorrel_.n_cols;
+  x = z.head_cols(k) * sqrtCorrel_.t();
+  for (size_t j = 0; j < nfactors_; ++j) {
+    double s = idioStdev_[j];
+    double* xj = x.colptr(j);
+    double const* ej = z.colptr(k + j);
+    for (size_t r = 0; r < nrows; ++r)
+      xj[r] += s * ej[r];
+  }
+}
+
+void PathGenerator::correlate(Matrix& pricePath)
+{
+  if (sqrtCorrel_.n_rows == 0)
+    return;
+  // all time steps at once, as one matrix multiply
+  scratch_.set_size(ntimesteps_, nfactors_);
+  correlateRows(pricePath.memptr(), scratch_.memptr(), ntimesteps_);
+  pricePath.swap(scratch_);
+}
+
+void PathGenerator::correlateBlock(Matrix& paths)
+{
+  if (sqrtCorrel_.n_rows == 0)
+    return;
+  // in the layout of nextBlock() the columns of one driver are contiguous, so the block
+  // is an (npaths * ntimesteps) x ndrivers matrix and all paths and time steps
+  // are correlated with one matrix multiply
+  size_t npaths = paths.n_rows;
+  scratch_.set_size(npaths, nfactors_ * ntimesteps_);
+  correlateRows(paths.memptr(), scratch_.memptr(), npaths * ntimesteps_);
+  paths.swap(scratch_);
+}
+
+void PathGenerator::stratifyColumns(double* devs, double const* keys, size_t npaths, size_t ncols)
+{
+  std::vector<size_t> order(npaths), strata(npaths);
+  const double umin = std::numeric_limits<double>::min();
+  const double umax = 1.0 - std::numeric_limits<double>::epsilon();
+  for (size_t c = 0; c < ncols; ++c) {
+    // the stratum of each path: the path index for the first column, the rank of its key otherwise
+    if (c == 0)
+      std::iota(strata.begin(), strata.end(), 0);
+    else {
+      double const* key = keys + c * npaths;
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [key](size_t a, size_t b) { return key[a] < key[b]; });
+      for (size_t r = 0; r < npaths; ++r)
+        strata[order[r]] = r;
+    }
+    // the uniform of each deviate is moved to its stratum, and mapped back by inversion
+    double* z = devs + c * npaths;
+    for (size_t p = 0; p < npaths; ++p) {
+      double u = 0.5 * std::erfc(-z[p] * M_SQRT1_2);
+      z[p] = std::min(std::max((strata[p] + u) / npaths, umin), umax);
+    }
+    normalInvCdfInPlace(z, npaths);
+  }
 }
 
 END_NAMESPACE(orf)
@@ -11,12 +11,18 @@
 #include <orflib/exception.hpp>
 #include <orflib/sptr.hpp>
 #include <orflib/math/matrix.hpp>
+#include <orflib/methods/montecarlo/mcparams.hpp>
 
 BEGIN_NAMESPACE(orf)
 
 /** The abstract base class for all Monte Carlo path generators.
     It must be inherited by specific path generators.
 */
+class PathGenerator;
+
+/** Smart pointer to PathGenerator */
+using SPtrPathGenerator = std::shared_ptr<PathGenerator>;
+
 class PathGenerator
 {
 public:
@@ -29,36 +35,156 @@ public:
   /** Returns the number of simulated factors */
   size_t nFactors() const;
 
+  /** Returns the number of independent deviates drawn per time step: the number of factors,
+      or the number of factors plus the number of common factors for a factor model
+  */
+  size_t nDrivers() const;
+
+  /** Sets the stratification of the paths returned by nextBlock().
+      The npaths paths of one call are stratified together: each stratified deviate takes one
+      value in each of npaths equiprobable strata, in path order for the first one and in a
+      random order for each other one, drawn with keys from the same stream. The paths of one call
+      are then not independent, and their mean is the sample, see StratifiedMeanVarCalculator.
+      TERMINAL stratifies the first deviate of each driver, which is the terminal value of its
+      Brownian motion for the BrownianBridgePathGenerator only; LATIN_HYPERCUBE stratifies all
+      of them. next() is not stratified.
+  */
+  void setStratification(McParams::StratificationType type);
+
   /** Returns the next price path.
       The Matrix is resized to size ntimesteps * nfactors
   */
   virtual void next(Matrix& pricePath) = 0;
 
-protected:
-  PathGenerator() {};     // default ctor
-  PathGenerator(size_t ntimesteps, size_t nfactors, Matrix const& correlation);
+  /** Returns the next npaths paths in structure-of-arrays layout.
+      The Matrix is resized to size npaths * (nfactors * ntimesteps);
+      row p holds path p and column j * ntimesteps + i holds factor j at time step i,
+      so that the values of one factor and time step are contiguous across paths.
+      The paths are the same as those returned by npaths calls to next().
+      This default implementation calls next() once per path.
+  */
+  virtual void nextBlock(size_t npaths, Matrix& paths);
+
+  /** Returns true if the generator can return a path step by step, see nextSteps() */
+  virtual bool hasIncrementalPaths() const;
+
+  /** Returns the deviates of the next nsteps time steps of the current path, for
+      pricers that stop simulating a path early. endPath() skips what is left of the
+      current path, so that the stream stays aligned with next() and nextBlock().
+      Only for generators where hasIncrementalPaths() is true.
+  */
+  virtual void nextSteps(size_t nsteps, double* devs);
+  virtual void endPath();
+
+  /** Returns a copy of this generator, in the same state */
+  virtual SPtrPathGenerator clone() const = 0;
 
-  // Does spectral truncation and Cholesky decomposition on the correlation matrix
-  void initCorrelation(Matrix const& correlation);
+  /** Skips the next npaths paths.
+      The state after the call is the same as after npaths calls to next().
+  */
+  virtual void discard(unsigned long npaths) = 0;
+
+  /** Restarts the generator, with the underlying random number generator seeded with s.
+      For a low discrepancy generator the seed selects the randomization of the sequence.
+  */
+  virtual void seed(unsigned long s) = 0;
+
+  /** Returns the seed of the last call to seed(), or 0 if the generator was never reseeded */
+  unsigned long lastSeed() const;
+
+protected:
+  PathGenerator() : stratification_(McParams::StratificationType::NONE), seed_(0) {};     // default ctor
+  PathGenerator(size_t ntimesteps, size_t nfactors, Matrix const& correlation,
+                McParams::CorrelFactorType factorType = McParams::CorrelFactorType::CHOLESKY,
+                size_t ncommonfactors = 0);
+
+  // Does spectral truncation and then Cholesky, principal component or factor model
+  // decomposition on the correlation matrix
+  void initCorrelation(Matrix const& correlation, McParams::CorrelFactorType factorType,
+                       size_t ncommonfactors);
+
+  // Maps independent deviates to correlated ones.
+  // correlate() takes a single ntimesteps x ndrivers path and returns it as ntimesteps x nfactors,
+  // correlateBlock() does the same for a block of paths in the layout of nextBlock(),
+  // npaths x (ndrivers * ntimesteps) in and npaths x (nfactors * ntimesteps) out
+  void correlate(Matrix& pricePath);
+  void correlateBlock(Matrix& paths);
+
+  // Returns the number of stratified deviates of a path: the first ndrivers for TERMINAL,
+  // all of them for LATIN_HYPERCUBE, none otherwise
+  size_t nStratified() const;
+
+  // Returns the number of deviates drawn per path by nextBlock(), including the keys of the strata
+  unsigned long long devsPerPath() const;
+
+  // Stratifies the first nStratified() columns of a block of npaths paths of normal deviates,
+  // stored with leading dimension npaths, see setStratification(). The keys that order the strata
+  // of each column are drawn from nrng into strataKeys_. Does nothing without a stratification.
+  template <typename NRNG>
+  void stratifyBlock(NRNG& nrng, double* devs, size_t npaths);
 
   size_t ntimesteps_;    // the number of time steps
   size_t nfactors_;      // the number of factors
-  Matrix sqrtCorrel_;    // the Cholesky factor of the correlation matrix
+  size_t ndrivers_;      // the number of independent deviates per time step
+  Matrix sqrtCorrel_;    // the correlation factor: Cholesky factor, scaled principal components,
+                         // or the nfactors x ncommonfactors loadings of a factor model
+  Vector idioStdev_;     // the idiosyncratic standard deviations of a factor model, else empty
+  McParams::StratificationType stratification_;  // the stratification of nextBlock()
+  unsigned long seed_;   // the last seed, see lastSeed()
+
+private:
+  // Writes x = z * sqrtCorrel_^T (plus the idiosyncratic terms of a factor model), where z is
+  // the nrows x ndrivers matrix at devs and x the nrows x nfactors matrix at out
+  void correlateRows(double* devs, double* out, size_t nrows);
+
+  // Maps the first ncols columns of devs to stratified deviates, ordering the strata of
+  // column c > 0 by the ranks of column c of keys
+  void stratifyColumns(double* devs, double const* keys, size_t npaths, size_t ncols);
+
+  Matrix scratch_;       // scratch array for correlate() and correlateBlock()
+  Matrix strataKeys_;    // scratch array, the keys of the strata of a block
 };
 
-using SPtrPathGenerator = std::shared_ptr<PathGenerator>;
-
 ///////////////////////////////////////////////////////////////////////////////
 // Inline definitions
 inline
-PathGenerator::PathGenerator(size_t ntimesteps, size_t nfactors, Matrix const& correlMatrix)
-: ntimesteps_(ntimesteps), nfactors_(nfactors)
+PathGenerator::PathGenerator(size_t ntimesteps, size_t nfactors, Matrix const& correlMatrix,
+                             McParams::CorrelFactorType factorType, size_t ncommonfactors)
+: ntimesteps_(ntimesteps), nfactors_(nfactors), ndrivers_(nfactors),
+  stratification_(McParams::StratificationType::NONE), seed_(0)
 {
   ORF_ASSERT(correlMatrix.is_square(), "the correlation matrix is not square!");
   if (!correlMatrix.is_empty())
     ORF_ASSERT(correlMatrix.n_rows == nfactors,
     "the correlation matrix number of rows is not equal to the number of factors!");
-  initCorrelation(correlMatrix);
+  initCorrelation(correlMatrix, factorType, ncommonfactors);
+}
+
+inline void PathGenerator::nextBlock(size_t npaths, Matrix& paths)
+{
+  paths.set_size(npaths, nfactors_ * ntimesteps_);
+  Matrix pricePath;
+  for (size_t p = 0; p < npaths; ++p) {
+    next(pricePath);
+    for (size_t j = 0; j < nfactors_; ++j)
+      for (size_t i = 0; i < ntimesteps_; ++i)
+        paths(p, j * ntimesteps_ + i) = pricePath(i, j);
+  }
+}
+
+inline bool PathGenerator::hasIncrementalPaths() const
+{
+  return false;
+}
+
+inline void PathGenerator::nextSteps(size_t, double*)
+{
+  ORF_ASSERT(0, "this path generator does not support incremental paths!");
+}
+
+inline void PathGenerator::endPath()
+{
+  ORF_ASSERT(0, "this path generator does not support incremental paths!");
 }
 
 inline size_t PathGenerator::nTimeSteps() const
@@ -71,6 +197,50 @@ inline size_t PathGenerator::nFactors() const
   return nfactors_;
 }
 
+inline size_t PathGenerator::nDrivers() const
+{
+  return ndrivers_;
+}
+
+inline unsigned long PathGenerator::lastSeed() const
+{
+  return seed_;
+}
+
+inline void PathGenerator::setStratification(McParams::StratificationType type)
+{
+  stratification_ = type;
+}
+
+inline size_t PathGenerator::nStratified() const
+{
+  if (stratification_ == McParams::StratificationType::TERMINAL)
+    return ndrivers_;
+  else if (stratification_ == McParams::StratificationType::LATIN_HYPERCUBE)
+    return ntimesteps_ * ndrivers_;
+  return 0;
+}
+
+inline unsigned long long PathGenerator::devsPerPath() const
+{
+  // a whole path of keys, if any strata are to be ordered
+  unsigned long long ndevs = ntimesteps_ * ndrivers_;
+  return nStratified() > 1 ? 2 * ndevs : ndevs;
+}
+
+template <typename NRNG>
+inline void PathGenerator::stratifyBlock(NRNG& nrng, double* devs, size_t npaths)
+{
+  size_t ncols = nStratified();
+  if (ncols == 0)
+    return;
+  if (ncols > 1) {
+    strataKeys_.set_size(npaths, ntimesteps_ * ndrivers_);
+    nrng.nextBlock(npaths, strataKeys_.memptr(), npaths);
+  }
+  stratifyColumns(devs, strataKeys_.memptr(), npaths, ncols);
+}
+
 END_NAMESPACE(orf)
 
 #endif // ORF_PATHGENERATOR_HPP
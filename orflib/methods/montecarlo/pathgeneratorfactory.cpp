@@ -0,0 +1,64 @@
+/**
+@file  pathgeneratorfactory.cpp
+@brief Implementation of the path generator factory
+*/
+
+#include <orflib/methods/montecarlo/pathgeneratorfactory.hpp>
+#include <orflib/methods/montecarlo/eulerpathgenerator.hpp>
+#include <orflib/methods/montecarlo/brownianbridgepathgenerator.hpp>
+
+BEGIN_NAMESPACE(orf)
+
+namespace {
+
+  // creates the path generator of the requested type for a given normal deviate generator
+  template <typename NRNG>
+  SPtrPathGenerator makePathGeneratorImpl(McParams const& mcparams,
+                                          Vector const& timesteps,
+                                          size_t nfactors,
+                                          Matrix const& correlMatrix)
+  {
+    SPtrPathGenerator pathgen;
+    // the terminal values are stratified through the Brownian bridge
+    if (mcparams.pathGenType == McParams::PathGenType::EULER
+        && mcparams.stratification != McParams::StratificationType::TERMINAL)
+      pathgen.reset(new EulerPathGenerator<NRNG>(
+        timesteps.begin(), timesteps.end(), nfactors, correlMatrix,
+        mcparams.correlFactorType, mcparams.nCorrelFactors));
+    else if (mcparams.pathGenType == McParams::PathGenType::EULER
+             || mcparams.pathGenType == McParams::PathGenType::BROWNIAN_BRIDGE)
+      pathgen.reset(new BrownianBridgePathGenerator<NRNG>(
+        timesteps.begin(), timesteps.end(), nfactors, correlMatrix,
+        mcparams.correlFactorType, mcparams.nCorrelFactors));
+    ORF_ASSERT(pathgen, "unknown path generator type!");
+    pathgen->setStratification(mcparams.stratification);
+    return pathgen;
+  }
+
+} // anonymous namespace
+
+SPtrPathGenerator makePathGenerator(McParams const& mcparams,
+                                    Vector const& timesteps,
+                                    size_t nfactors,
+                                    Matrix const& correlMatrix)
+{
+  if (mcparams.urngType == McParams::UrngType::MINSTDRAND)
+    return makePathGeneratorImpl<NormalRngMinStdRand>(mcparams, timesteps, nfactors, correlMatrix);
+  else if (mcparams.urngType == McParams::UrngType::MT19937)
+    return makePathGeneratorImpl<NormalRngMt19937>(mcparams, timesteps, nfactors, correlMatrix);
+  else if (mcparams.urngType == McParams::UrngType::RANLUX3)
+    return makePathGeneratorImpl<NormalRngRanLux3>(mcparams, timesteps, nfactors, correlMatrix);
+  else if (mcparams.urngType == McParams::UrngType::RANLUX4)
+    return makePathGeneratorImpl<NormalRngRanLux4>(mcparams, timesteps, nfactors, correlMatrix);
+  else if (mcparams.urngType == McParams::UrngType::PHILOX)
+    return makePathGeneratorImpl<NormalRngPhilox>(mcparams, timesteps, nfactors, correlMatrix);
+  else if (mcparams.urngType == McParams::UrngType::SOBOL) {
+    ORF_ASSERT(mcparams.stratification == McParams::StratificationType::NONE,
+      "the Sobol sequence cannot be stratified!");
+    return makePathGeneratorImpl<NormalRngSobol>(mcparams, timesteps, nfactors, correlMatrix);
+  }
+  ORF_ASSERT(0, "unknown urng type!");
+  return SPtrPathGenerator();
+}
+
+END_NAMESPACE(orf)
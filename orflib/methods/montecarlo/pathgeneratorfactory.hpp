@@ -0,0 +1,28 @@
+/**
+@file  pathgeneratorfactory.hpp
+@brief Creation of the path generator selected by the Monte Carlo parameters
+*/
+
+#ifndef ORF_PATHGENERATORFACTORY_HPP
+#define ORF_PATHGENERATORFACTORY_HPP
+
+#include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/methods/montecarlo/mcparams.hpp>
+
+BEGIN_NAMESPACE(orf)
+
+/** Creates the path generator of type mcparams.pathGenType, driven by a normal
+    deviate generator of type mcparams.urngType, for nfactors factors simulated
+    on the given time steps.
+    If the correlation matrix is not passed in, the factors are independent.
+    The generator stratifies its blocks of paths as set by mcparams.stratification,
+    with the Brownian bridge for terminal stratification, see PathGenerator::setStratification.
+*/
+SPtrPathGenerator makePathGenerator(McParams const& mcparams,
+                                    Vector const& timesteps,
+                                    size_t nfactors,
+                                    Matrix const& correlMatrix = Matrix());
+
+END_NAMESPACE(orf)
+
+#endif // ORF_PATHGENERATORFACTORY_HPP
@@ -0,0 +1,56 @@
+/**
+@file  singleprecisionpaths.hpp
+@brief Conversion of a block of normal deviates to prices in single precision
+*/
+
+#ifndef ORF_SINGLEPRECISIONPATHS_HPP
+#define ORF_SINGLEPRECISIONPATHS_HPP
+
+#include <orflib/defines.hpp>
+#include <orflib/math/vectormath.hpp>
+
+#include <vector>
+
+BEGIN_NAMESPACE(orf)
+
+/** Converts the normal deviates of one asset in a block of paths to prices, in place, with the
+    log returns accumulated and exponentiated in single precision, see McParams::singlePrecision.
+    paths holds ntimesteps columns of npaths deviates, in the layout of PathGenerator::nextBlock;
+    over time step i the log spot moves by drifts[i] + stdevs[i] * z. buf is scratch space.
+    The log returns are relative to the spot, so that they stay small, and the spot multiplies
+    the prices in double precision. The rounding errors of time step i add at most about
+    3 * 2^-24 * M to the log return, M the largest absolute log return or increment along the path,
+    and the exponential adds a relative error below 2^-23: for n time steps the relative error
+    of a price is at most about (3 n M + 2) * 2^-24, e.g. 1.1e-5 for 365 steps with M = 0.5.
+    The errors are of either sign, so that the bias of a mean PV is typically of the order of
+    sqrt(n) times smaller, far below the standard error of any practical simulation.
+*/
+inline void toPricesSinglePrecision(double* paths, size_t npaths, size_t ntimesteps, double spot,
+                                    double const* drifts, double const* stdevs, std::vector<float>& buf)
+{
+  size_t n = npaths * ntimesteps;
+  buf.resize(n);
+  float* x = buf.data();
+  // the log returns since t = 0, one time step at a time across all paths
+  float drift = static_cast<float>(drifts[0]);
+  float stdev = static_cast<float>(stdevs[0]);
+  for (size_t p = 0; p < npaths; ++p)
+    x[p] = drift + stdev * static_cast<float>(paths[p]);
+  for (size_t i = 1; i < ntimesteps; ++i) {
+    float const* xprev = x + (i - 1) * npaths;
+    float* xi = x + i * npaths;
+    double const* z = paths + i * npaths;
+    drift = static_cast<float>(drifts[i]);
+    stdev = static_cast<float>(stdevs[i]);
+    for (size_t p = 0; p < npaths; ++p)
+      xi[p] = xprev[p] + drift + stdev * static_cast<float>(z[p]);
+  }
+  // then to prices, in one pass over the whole block
+  expInPlace(x, n);
+  for (size_t k = 0; k < n; ++k)
+    paths[k] = spot * x[k];
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_SINGLEPRECISIONPATHS_HPP
@@ -85,19 +85,9 @@ void Pde1DSolver::evalProduct(size_t stepIdx)
 {
   ptrdiff_t eventIdx = stepindex_[stepIdx];
   if (eventIdx >= 0) {             // product event, must evaluate
-    Vector const & payTms = spprod_->payTimes();       // the payment times
-    double fixtime = spprod_->fixTimes()[eventIdx]; // the fixing time
-    Vector spots(1);                                   // one underlying spot
-    for (size_t node = 0; node <= gridAxes_[0].NX + 1; ++node) {
-      spots[0] = gridAxes_[0].Slevels[node];
-      spprod_->eval(eventIdx, spots, (*prevValues)(node, 0));
-      // read out the ammounts
-      Vector const & payAms = spprod_->payAmounts();
-      size_t i = 0;
-      while (fixtime > payTms[i]) ++i;
-      // TODO: fwd discount
-      (*prevValues)(node, 0) = payAms[eventIdx];
-    }
+    // on all the nodes at once, replacing the continuation values by the payment amounts
+    // TODO: fwd discount
+    spprod_->evalGrid(eventIdx, gridAxes_[0].Slevels, prevValues->colptr(0));
   }
   results_.times[stepIdx] = timesteps_[stepIdx];
   if (storeAllResults_)
@@ -125,7 +125,7 @@ void PdeBase::initGrid(double T, PdeParams const& params)
 }
 
 /** Updates the grid axes for this time step index */
-void PdeBase::updateGrid(PdeParams const& params,
+void PdeBase::updateGrid(PdeParams const&,
                          Matrix const& fwdFactors,
                          Matrix const& fvols,
                          size_t stepIdx)
@@ -135,17 +135,13 @@ void PdeBase::updateGrid(PdeParams const& params,
   double DT = T2 - T1;
 
   for (size_t assetIdx = 0; assetIdx < nAssets_; ++assetIdx) {
-    for (size_t j = 1; j <= params.nSpotNodes[assetIdx]; ++j) {
-      GridAxis& grax = gridAxes_[assetIdx];
-      double RealS = grax.Slevels[j];
-      double aCoeff = fwdFactors(stepIdx, assetIdx);
-      double RealF = RealS * aCoeff;
-      //changed for step localvol
-      double RealLNvol = fvols(stepIdx, assetIdx);
-      // set the drift, variance and vol values for this time step
-      grax.coordinateChange->driftAndVariance(RealS, RealF, theta_, DT, RealLNvol,
-        aCoeff, grax.DX, grax.drifts[j - 1], grax.variances[j - 1], grax.vols[j - 1]);
-    }
+    GridAxis& grax = gridAxes_[assetIdx];
+    double aCoeff = fwdFactors(stepIdx, assetIdx);
+    //changed for step localvol
+    double RealLNvol = fvols(stepIdx, assetIdx);
+    // set the drift, variance and vol values for this time step, on all interior nodes at once
+    grax.coordinateChange->driftsAndVariances(grax.Slevels, theta_, DT, RealLNvol,
+      aCoeff, grax.DX, grax.drifts, grax.variances, grax.vols);
   }
 }
 
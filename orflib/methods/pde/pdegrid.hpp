@@ -46,6 +46,23 @@ public:
                                 double& variance,
                                 double& FinalVol) = 0;
 
+  /** Computes the drift, variance and vol of the interior nodes of an axis for one time step,
+      as driftAndVariance does for one node: realS holds the spots of all nodes, including the
+      two boundary ones, and the results of interior node j go to element j - 1 of drifts,
+      variances and vols, whose size is the number of interior nodes.
+      The forward of node j is realS[j] * aCoeff.
+      The default implementation calls driftAndVariance node by node.
+  */
+  virtual void driftsAndVariances(Vector const& realS,
+                                  double theta,
+                                  double DT,
+                                  double realLNVol,
+                                  double aCoeff,
+                                  double DX,
+                                  Vector& drifts,
+                                  Vector& variances,
+                                  Vector& vols);
+
   /** Computes the grid bounds Xmin and Xmax */
   virtual void bounds(double S0,
                       double fwd,
@@ -56,9 +73,50 @@ public:
                       double& Xmax) = 0;
 };
 
+inline
+void CoordinateChangeBase::driftsAndVariances(Vector const& realS, double theta, double DT, double realLNVol,
+                                              double aCoeff, double DX, Vector& drifts, Vector& variances,
+                                              Vector& vols)
+{
+  for (size_t j = 1; j <= drifts.n_elem; ++j)
+    driftAndVariance(realS[j], realS[j] * aCoeff, theta, DT, realLNVol, aCoeff, DX,
+                     drifts[j - 1], variances[j - 1], vols[j - 1]);
+}
+
+
+/** Base class template for the coordinate changes, to be derived from as
+    class MyCoordinateChange : public CoordinateChange<MyCoordinateChange>.
+    It implements the loop over the nodes of driftsAndVariances with direct calls to
+    DERIVED::driftAndVariance, which the compiler can inline and vectorize.
+*/
+template <typename DERIVED>
+class CoordinateChange : public CoordinateChangeBase
+{
+public:
+  virtual void driftsAndVariances(Vector const& realS,
+                                  double theta,
+                                  double DT,
+                                  double realLNVol,
+                                  double aCoeff,
+                                  double DX,
+                                  Vector& drifts,
+                                  Vector& variances,
+                                  Vector& vols) override
+  {
+    DERIVED& self = static_cast<DERIVED&>(*this);
+    double const* S = realS.memptr();
+    double* drift = drifts.memptr();
+    double* variance = variances.memptr();
+    double* vol = vols.memptr();
+    for (size_t j = 1; j <= drifts.n_elem; ++j)
+      self.DERIVED::driftAndVariance(S[j], S[j] * aCoeff, theta, DT, realLNVol, aCoeff, DX,
+                                     drift[j - 1], variance[j - 1], vol[j - 1]);
+  }
+};
+
 
 /** Identity coordinate change, i.e. Diffused = Real */
-class NoCoordinateChange : public CoordinateChangeBase
+class NoCoordinateChange : public CoordinateChange<NoCoordinateChange>
 {
 public:
   virtual double fromRealToDiffused(double S)
@@ -108,7 +166,7 @@ public:
 };
 
 /** Logarithmic coordinate change, i.e. Diffused = log(Real) */
-class LogCoordinateChange : public CoordinateChangeBase
+class LogCoordinateChange : public CoordinateChange<LogCoordinateChange>
 {
 public:
 
@@ -150,9 +208,12 @@ public:
                                 double& variance,
                                 double& finalVol)
   {
-    double Xi = fromRealToDiffused(realS);
-    double Deltaip1 = (fromDiffusedToReal(Xi + DX) - fromDiffusedToReal(Xi - DX)) / (2.0 * DX);
-    double Gammaip1 = (fromDiffusedToReal(Xi + DX) - 2 * fromDiffusedToReal(Xi) + fromDiffusedToReal(Xi - DX));
+    // direct calls, for driftsAndVariances
+    double Xi = LogCoordinateChange::fromRealToDiffused(realS);
+    double Xup = LogCoordinateChange::fromDiffusedToReal(Xi + DX);
+    double Xdown = LogCoordinateChange::fromDiffusedToReal(Xi - DX);
+    double Deltaip1 = (Xup - Xdown) / (2.0 * DX);
+    double Gammaip1 = (Xup - 2 * LogCoordinateChange::fromDiffusedToReal(Xi) + Xdown);
     Gammaip1 /= (DX * DX);
     double corr = (theta*aCoeff + 1 - theta);
     drift = (realF - realS) / corr / DT / Deltaip1 - 0.5 * realLNVol * realLNVol * Gammaip1 / Deltaip1;
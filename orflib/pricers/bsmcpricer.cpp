@@ -4,9 +4,18 @@
 */
 
 #include <orflib/pricers/bsmcpricer.hpp>
-#include <orflib/methods/montecarlo/eulerpathgenerator.hpp>
+#include <orflib/methods/montecarlo/pathgeneratorfactory.hpp>
+#include <orflib/methods/montecarlo/gbmsteps.hpp>
+#include <orflib/methods/montecarlo/momentmatching.hpp>
+#include <orflib/methods/montecarlo/singleprecisionpaths.hpp>
+#include <orflib/products/europeancallput.hpp>
+#include <orflib/pricers/simplepricers.hpp>
+#include <orflib/math/vectormath.hpp>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <typeinfo>
 
 using namespace std;
 
@@ -15,38 +24,19 @@ BEGIN_NAMESPACE(orf)
 BsMcPricer::BsMcPricer(SPtrProduct prod,
                        SPtrYieldCurve discountCurve,
                        double divYield,
-                       double volatility,
+                       SPtrVolatilityTermStructure volatility,
                        double spot,
                        McParams mcparams)
 : prod_(prod), discyc_(discountCurve), divyld_(divYield), vol_(volatility),
-spot_(spot), mcparams_(mcparams)
+spot_(spot), mcparams_(mcparams), firstStep_(0), spotBump_(1.0e-4 * spot), volBump_(0.0),
+isShiftNorm2_(0.0), ctrlPrice_(0.0), ctrlCoef_(0.0), ctrlCoefSet_(false)
 {
   // Get the simulation times
   Vector timesteps = prod->fixTimes();
   size_t ntimesteps = timesteps.size();
 
   // Create the path generator, one factor to simulate the spot
-  if (mcparams.pathGenType == McParams::PathGenType::EULER) {
-    if (mcparams.urngType == McParams::UrngType::MINSTDRAND)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngMinStdRand>(
-          timesteps.begin(), timesteps.end(), 1));
-    else if (mcparams.urngType == McParams::UrngType::MT19937)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngMt19937>(
-          timesteps.begin(), timesteps.end(), 1));
-    else if (mcparams.urngType == McParams::UrngType::RANLUX3)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngRanLux3>(
-          timesteps.begin(), timesteps.end(), 1));
-    else if (mcparams.urngType == McParams::UrngType::RANLUX4)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngRanLux4>(
-          timesteps.begin(), timesteps.end(), 1));
-    else if (mcparams.urngType == McParams::UrngType::SOBOL)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngSobol>(
-          timesteps.begin(), timesteps.end(), 1));
-    else
-      ORF_ASSERT(0, "unknown urng type!");
-  } 
-  else
-    ORF_ASSERT(0, "unknown path generator type!");
+  pathgen_ = makePathGenerator(mcparams, timesteps, 1);
 
   // Pre-compute the discount factors
   Vector const& paytimes = prod->payTimes();
@@ -56,43 +46,512 @@ spot_(spot), mcparams_(mcparams)
 
   // Pre-compute the stdevs and drifts from time step to time step
   Vector const& fixtimes = prod->fixTimes();
-  double t1 = 0.0;
-  drifts_.resize(fixtimes.size());
-  stdevs_.resize(fixtimes.size());
-  for (size_t i = 0; i < fixtimes.size(); ++i) {
-    double t2 = fixtimes[i];
-    double var = vol_ * vol_ * (t2 - t1);
-    stdevs_[i] = sqrt(var);
-    double fwdrate = discyc_->fwdRate(t1, t2);
-    // risk free rate less yield plus convexity adjustment
-    drifts_[i] = (fwdrate - divyld_) * (t2 - t1) - 0.5 * var;
-    t1 = t2;
-  }
-
-  // Resize the payment amounts
-  payamts_.resize(prod->payTimes().size());
+  GbmSteps steps(fixtimes, discyc_, divyld_, vol_);
+  drifts_ = steps.drifts();
+  stdevs_ = steps.stdevs();
+  sqrtdts_ = steps.sqrtdts();
+  volDerivs_ = steps.volDerivs();
+  // the spot only enters the path density through the first step of positive length
+  while (firstStep_ < fixtimes.size() && sqrtdts_[firstStep_] == 0.0)
+    ++firstStep_;
+  ORF_ASSERT(!mcparams.greeks || firstStep_ < fixtimes.size(),
+    "BsMcPricer: the Greeks need a fixing time after t = 0!");
+  ORF_ASSERT(!mcparams.greeks || !mcparams.singlePrecision,
+    "BsMcPricer: the Greeks need double precision paths!");
+
+  // For the rhos, the derivatives of the drifts and of the discount factors with respect
+  // to the forward rates of the curve; they do not depend on the path
+  if (mcparams.greeks) {
+    size_t nrates = discyc_->nFwdRates();
+    Vector derivs;
+    driftRateDerivs_.zeros(fixtimes.size(), nrates);
+    // the vega bumps all the forward vols by the same amount
+    volBump_ = 1.0e-4 * vol_->spotVol(fixtimes[fixtimes.size() - 1]);
+    for (size_t i = 0; i < fixtimes.size(); ++i) {
+      double t1 = i > 0 ? fixtimes[i - 1] : 0.0;
+      if (fixtimes[i] > t1) {
+        discyc_->fwdRateIntegralDerivs(t1, fixtimes[i], derivs);
+        for (size_t k = 0; k < nrates; ++k)
+          driftRateDerivs_(i, k) = derivs[k];
+      }
+    }
+    discRateDerivs_.zeros(paytimes.size(), nrates);
+    for (size_t q = 0; q < paytimes.size(); ++q) {
+      discyc_->fwdRateIntegralDerivs(0.0, paytimes[q], derivs);
+      for (size_t k = 0; k < nrates; ++k)
+        discRateDerivs_(q, k) = -discfactors_[q] * derivs[k];
+    }
+  }
+
+  // Pass the initial spot and the log variances to the product, for monitoring between
+  // fixings; on a copy, so that the caller's product is left untouched
+  prod_ = prod->clone();
+  Vector spots(1);
+  spots[0] = spot_;
+  Matrix logvars(stdevs_.n_elem, 1);
+  for (size_t i = 0; i < stdevs_.n_elem; ++i)
+    logvars(i, 0) = stdevs_[i] * stdevs_[i];
+  prod_->setBridgeData(spots, logvars);
+
+  // For the likelihood ratio Greeks, copies with bumped bridge data give the derivatives
+  // of the PV through the bridge data
+  if (mcparams.greeks) {
+    for (int k = 0; k < 4; ++k) {
+      Vector bspots(spots);
+      Matrix blogvars(logvars);
+      if (k < 2)
+        bspots[0] += k == 0 ? spotBump_ : -spotBump_;
+      else {
+        double dvol = k == 2 ? volBump_ : -volBump_;
+        // int (vol + dvol)^2 dt over each step
+        for (size_t i = 0; i < blogvars.n_rows; ++i)
+          blogvars(i, 0) += dvol * (2.0 * stdevs_[i] * volDerivs_[i] + dvol * sqrtdts_[i] * sqrtdts_[i]);
+      }
+      SPtrProduct bumped = prod->clone();
+      bumped->setBridgeData(bspots, blogvars);
+      bridgeBumps_.push_back(bumped);
+    }
+  }
+
+  // Knock-out barriers in log space, to stop simulating knocked out paths
+  Vector lower, upper;
+  if (prod_->knockOutBarriers(lower, upper)) {
+    logLower_.resize(lower.n_elem);
+    logUpper_.resize(upper.n_elem);
+    for (size_t i = 0; i < lower.n_elem; ++i) {
+      logLower_[i] = log(lower[i]);      // -infinity for no barrier
+      logUpper_[i] = log(upper[i]);
+    }
+  }
+
+  // The importance sampling drift, once the product has its bridge data
+  if (mcparams.importanceSampling) {
+    ORF_ASSERT(!mcparams.greeks, "BsMcPricer: importance sampling cannot be combined with the Greeks!");
+    double theta = findImportanceShift();
+    if (theta != 0.0) {
+      isShifts_.resize(fixtimes.size());
+      for (size_t i = 0; i < fixtimes.size(); ++i)
+        isShifts_[i] = theta * sqrtdts_[i];
+      isShiftNorm2_ = theta * theta * fixtimes[fixtimes.size() - 1];
+    }
+  }
+
+  // Set up the control variate, if requested and the product has one
+  if (mcparams.controlVariate)
+    ctrl_ = prod->controlVariate();
+  if (ctrl_) {
+    Product const& ctrl = *ctrl_;
+    ORF_ASSERT(typeid(ctrl) == typeid(EuropeanCallPut),
+      "BsMcPricer: only European calls and puts are supported as control variates!");
+    EuropeanCallPut const& euro = static_cast<EuropeanCallPut const&>(ctrl);
+    double T = euro.timeToExp();
+    double r = -log(discyc_->discount(T)) / T;
+    // the terminal spot only depends on the total variance up to T
+    ctrlPrice_ = europeanOptionBS(euro.payoffType(), spot_, euro.strike(), T, r, divyld_, vol_->spotVol(T))[0];
+
+    // locate the control fixings among the product fixings
+    Vector const& ctrlfix = ctrl_->fixTimes();
+    ctrlFixIdx_.resize(ctrlfix.size());
+    for (size_t k = 0; k < ctrlfix.size(); ++k) {
+      size_t i = 0;
+      while (i < fixtimes.size() && fixtimes[i] != ctrlfix[k])
+        ++i;
+      ORF_ASSERT(i < fixtimes.size(), "BsMcPricer: the control variate fixing times must be product fixing times!");
+      ctrlFixIdx_[k] = i;
+    }
+    Vector const& ctrlpay = ctrl_->payTimes();
+    ctrlDiscfactors_.resize(ctrlpay.size());
+    for (size_t i = 0; i < ctrlpay.size(); ++i)
+      ctrlDiscfactors_[i] = discyc_->discount(ctrlpay[i]);
+  }
+}
+
+void BsMcPricer::processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const
+{
+  // early termination needs paths in time order, no statistic over whole paths and a product
+  // that streams them; the Greeks need the paths knocked out by the product, but maybe not
+  // by the bumped ones, in full
+  if (!logLower_.is_empty() && pathgen.hasIncrementalPaths() && prod.hasStreamingEval() && !mcparams_.momentMatching
+      && !ctrl_ && !mcparams_.greeks && isShifts_.is_empty()) {
+    processPathsIncremental(pathgen, prod, ws, npaths);
+    return;
+  }
 
+  pathgen.nextBlock(npaths, ws.paths);
+  if (mcparams_.momentMatching)
+    matchMoments(ws.paths);
+  if (mcparams_.antithetic)
+    mirrorDeviates(ws.paths, ws.mirrorPaths);
+
+  ws.pvs.zeros(npaths * nVariables());
+  if (ctrl_) {
+    ws.controlPvs.zeros(npaths);
+    if (!ws.control)
+      ws.control = ctrl_->clone();
+  }
+  if (mcparams_.greeks)
+    toBrownians(ws.paths, ws.brownians);
+  double weight = mcparams_.antithetic ? 0.5 : 1.0;
+  if (!isShifts_.is_empty())
+    shiftDeviates(ws.paths, ws.lrWeights);
+  toPrices(ws.paths, ws);
+  addPVs(prod, ws, ws.paths, weight, 1.0);
+  if (mcparams_.antithetic) {
+    if (!isShifts_.is_empty())
+      shiftDeviates(ws.mirrorPaths, ws.lrWeights);
+    toPrices(ws.mirrorPaths, ws);
+    addPVs(prod, ws, ws.mirrorPaths, weight, -1.0);
+  }
 }
 
+void BsMcPricer::processPathsIncremental(PathGenerator& pathgen, Product& prod, McWorkspace& ws,
+                                         size_t npaths) const
+{
+  size_t ntimesteps = drifts_.n_elem;
+  size_t nmirrors = mcparams_.antithetic ? 2 : 1;
+  double weight = 1.0 / nmirrors;
+  double logspot = log(spot_);
+  ws.pvs.zeros(npaths);
+  ws.paths.set_size(ntimesteps, nmirrors);    // the log spots of the path and of its mirror
+  ws.slice.set_size(1);
+
+  for (size_t p = 0; p < npaths; ++p) {
+    bool alive[2] = { true, nmirrors == 2 };
+    double x[2] = { logspot, logspot };
+    // step in log space, while the path or its mirror is alive
+    for (size_t i = 0; i < ntimesteps && (alive[0] || alive[1]); ++i) {
+      double z;
+      pathgen.nextSteps(1, &z);
+      for (size_t m = 0; m < nmirrors; ++m) {
+        if (!alive[m])
+          continue;
+        x[m] += drifts_[i] + stdevs_[i] * (m == 0 ? z : -z);
+        ws.paths(i, m) = x[m];
+        alive[m] = x[m] > logLower_[i] && x[m] < logUpper_[i];
+      }
+    }
+    pathgen.endPath();
+
+    // knocked out paths pay nothing; the others are converted to prices, in one pass,
+    // and streamed to the product, up to the last fixing its payments depend on
+    for (size_t m = 0; m < nmirrors; ++m) {
+      if (!alive[m])
+        continue;
+      double* s = ws.paths.colptr(m);
+      expInPlace(s, ntimesteps);
+      prod.startPath();
+      for (size_t i = 0; i < ntimesteps; ++i) {
+        ws.slice[0] = s[i];
+        if (!prod.observeFixing(i, ws.slice))
+          break;
+      }
+      prod.finishPath();
+      Vector const& payamts = prod.payAmounts();
+
+      double pv = 0.0;
+      for (size_t i = 0; i < payamts.size(); ++i)
+        pv += discfactors_[i] * payamts[i];
+      ws.pvs[p] += weight * pv;
+    }
+  }
+}
 
-double BsMcPricer::processOnePath(Matrix& pricePath)
+void BsMcPricer::toPrices(Matrix& paths, McWorkspace& ws) const
 {
-  pathgen_->next(pricePath);
-  // convert the normal deviates to a price path in-place
-  double spot = spot_;
-  for (size_t i = 0; i < pricePath.n_rows; ++i) {
-    double normaldeviate = pricePath(i, 0);
-    pricePath(i, 0) = spot * exp(drifts_[i] + stdevs_[i] * normaldeviate);
-    spot = pricePath(i, 0);
-  }
-  prod_->eval(pricePath);
-  payamts_ = prod_->payAmounts();
-
-  double pv = 0.0;
-  for (size_t i = 0; i < payamts_.size(); ++i)
-    pv += discfactors_[i] * payamts_[i];
-
-  return pv;
+  if (mcparams_.singlePrecision) {
+    toPricesSinglePrecision(paths.memptr(), paths.n_rows, paths.n_cols, spot_,
+                            drifts_.memptr(), stdevs_.memptr(), ws.floatPaths);
+    return;
+  }
+  toGbmPrices(paths.memptr(), paths.n_rows, paths.n_cols, spot_, drifts_.memptr(), stdevs_.memptr());
+}
+
+void BsMcPricer::addPVs(Product& prod, McWorkspace& ws, Matrix const& paths, double weight, double wsign) const
+{
+  size_t ntimesteps = paths.n_cols;
+  size_t npaths = paths.n_rows;
+  size_t nvars = nVariables();
+  ws.pricePath.set_size(ntimesteps, 1);
+  // without Greeks, the PVs of the whole block in one call
+  if (!mcparams_.greeks)
+    prod.evalBlock(paths, discfactors_, ws.blockPvs);
+  for (size_t p = 0; p < npaths; ++p) {
+    bool pathwise = false;
+    if (mcparams_.greeks) {
+      for (size_t i = 0; i < ntimesteps; ++i)
+        ws.pricePath(i, 0) = paths(p, i);
+      pathwise = prod.evalPathwise(ws.pricePath, ws.payDerivs);
+    }
+    Vector const& payamts = prod.payAmounts();   // set by evalPathwise only
+
+    double pv = 0.0;
+    if (mcparams_.greeks) {
+      for (size_t i = 0; i < payamts.size(); ++i)
+        pv += discfactors_[i] * payamts[i];
+    }
+    else
+      pv = ws.blockPvs[p];
+    double* out = &ws.pvs[p * nvars];
+    // with importance sampling, the PVs are weighted with the likelihood ratio of the path
+    double pvweight = isShifts_.is_empty() ? weight : weight * ws.lrWeights[p];
+    out[0] += pvweight * pv;
+
+    if (mcparams_.greeks) {
+      size_t nrates = driftRateDerivs_.n_cols;
+      ws.greeks.set_size(3 + nrates);
+      double* greeks = ws.greeks.memptr();
+      double const* w = ws.brownians.colptr(p);
+      if (pathwise)
+        pathwiseGreeks(ws, payamts, w, wsign, greeks);
+      else {
+        // recover the normal deviates from the Brownian motion; a deviate shifts the log spot
+        // by its drift, whose score is z / stdev
+        double z0 = 0.0, vegaScore = 0.0, wprev = 0.0;
+        for (size_t k = 0; k < nrates; ++k)
+          greeks[3 + k] = 0.0;
+        for (size_t i = firstStep_; i < ntimesteps; ++i) {
+          if (sqrtdts_[i] == 0.0)
+            continue;
+          double z = wsign * (w[i] - wprev) / sqrtdts_[i];
+          wprev = w[i];
+          if (i == firstStep_)
+            z0 = z;
+          vegaScore += volDerivs_[i] * ((z * z - 1.0) / stdevs_[i] - z);
+          double driftScore = pv * z / stdevs_[i];
+          for (size_t k = 0; k < nrates; ++k)
+            greeks[3 + k] += driftScore * driftRateDerivs_(i, k);
+        }
+        lrGreeks(ws, pv, z0, vegaScore, greeks);
+        // the payments move with the discount factors
+        for (size_t k = 0; k < nrates; ++k)
+          for (size_t q = 0; q < payamts.size(); ++q)
+            greeks[3 + k] += payamts[q] * discRateDerivs_(q, k);
+      }
+      for (size_t g = 0; g < 3 + nrates; ++g)
+        out[1 + g] += weight * greeks[g];
+    }
+  }
+
+  if (ctrl_) {
+    // the control sees its fixings only, gathered from the block
+    ws.controlPath.set_size(npaths, ctrlFixIdx_.size());
+    for (size_t k = 0; k < ctrlFixIdx_.size(); ++k)
+      std::copy(paths.colptr(ctrlFixIdx_[k]), paths.colptr(ctrlFixIdx_[k]) + npaths, ws.controlPath.colptr(k));
+    ws.control->evalBlock(ws.controlPath, ctrlDiscfactors_, ws.blockPvs);
+    for (size_t p = 0; p < npaths; ++p) {
+      double pvweight = isShifts_.is_empty() ? weight : weight * ws.lrWeights[p];
+      ws.controlPvs[p] += pvweight * ws.blockPvs[p];
+    }
+  }
+}
+
+void BsMcPricer::toBrownians(Matrix const& paths, Matrix& brownians) const
+{
+  size_t npaths = paths.n_rows;
+  size_t ntimesteps = paths.n_cols;
+  brownians.set_size(ntimesteps, npaths);
+  for (size_t p = 0; p < npaths; ++p) {
+    double w = 0.0;
+    for (size_t i = 0; i < ntimesteps; ++i) {
+      w += sqrtdts_[i] * paths(p, i);
+      brownians(i, p) = w;
+    }
+  }
+}
+
+void BsMcPricer::pathwiseGreeks(McWorkspace& ws, Vector const& payamts,
+                                double const* w, double wsign, double* greeks) const
+{
+  // S_i = S_0 exp(sum_k<=i drift_k + stdev_k z_k), with drift_k including -stdev_k^2 / 2;
+  // hence dS_i/dS_0 = S_i / S_0 and, for a parallel shift of the forward vols,
+  // dS_i/dvol = S_i sum_k<=i dstdev_k (z_k - stdev_k), with dstdev_k from GbmSteps::volDerivs
+  Matrix const& pricePath = ws.pricePath;
+  Matrix const& payDerivs = ws.payDerivs;
+  size_t ntimesteps = payDerivs.n_cols;
+  size_t nrates = driftRateDerivs_.n_cols;
+  double dspot = 0.0, dvol = 0.0;
+  // the log spot at step i moves with the drifts of steps 0 to i: the adjoint of the drift
+  // of step i accumulates those of the log spots from the last step back
+  ws.adjoints.zeros(ntimesteps);
+  double xbar = 0.0;
+  for (size_t k = ntimesteps; k-- > 0;) {
+    double sbar = 0.0;
+    for (size_t i = 0; i < payDerivs.n_rows; ++i)
+      sbar += discfactors_[i] * payDerivs(i, k);
+    if (sbar != 0.0) {
+      double S = pricePath[k];
+      dspot += sbar * S;
+      xbar += sbar * S;
+    }
+    ws.adjoints[k] = xbar;
+  }
+  // the log spot of step k moves with the stdevs of steps 0 to k, like with the drifts
+  double wlast = 0.0;
+  for (size_t k = 0; k < ntimesteps; ++k) {
+    if (sqrtdts_[k] == 0.0)
+      continue;
+    double z = wsign * (w[k] - wlast) / sqrtdts_[k];
+    wlast = w[k];
+    dvol += ws.adjoints[k] * volDerivs_[k] * (z - stdevs_[k]);
+  }
+  for (size_t k = 0; k < nrates; ++k) {
+    double rbar = 0.0;
+    for (size_t i = 0; i < ntimesteps; ++i)
+      rbar += ws.adjoints[i] * driftRateDerivs_(i, k);
+    for (size_t q = 0; q < payamts.size(); ++q)
+      rbar += payamts[q] * discRateDerivs_(q, k);
+    greeks[3 + k] = rbar;
+  }
+  double wprev = firstStep_ > 0 ? w[firstStep_ - 1] : 0.0;
+  double z0 = wsign * (w[firstStep_] - wprev) / sqrtdts_[firstStep_];
+  greeks[0] = dspot / spot_;
+  // the likelihood ratio derivative of the pathwise delta, which is linear in 1 / S_0
+  greeks[1] = greeks[0] * (z0 / stdevs_[firstStep_] - 1.0) / spot_;
+  greeks[2] = dvol;
+}
+
+void BsMcPricer::lrGreeks(McWorkspace& ws, double pv, double z0, double vegaScore, double* greeks) const
+{
+  // the PVs of the same path through the products with bumped bridge data and spot
+  if (ws.bumpedProducts.empty()) {
+    for (auto const& bumped : bridgeBumps_)
+      ws.bumpedProducts.push_back(bumped->clone());
+  }
+  // the fixings at t = 0, if any, are the spot itself and move with it
+  double bumpedPvs[4];
+  for (size_t k = 0; k < 4; ++k) {
+    for (size_t i = 0; i < firstStep_; ++i)
+      ws.pricePath[i] = spot_ + (k == 0 ? spotBump_ : k == 1 ? -spotBump_ : 0.0);
+    ws.bumpedProducts[k]->eval(ws.pricePath);
+    Vector const& payamts = ws.bumpedProducts[k]->payAmounts();
+    bumpedPvs[k] = 0.0;
+    for (size_t i = 0; i < payamts.size(); ++i)
+      bumpedPvs[k] += discfactors_[i] * payamts[i];
+  }
+  for (size_t i = 0; i < firstStep_; ++i)
+    ws.pricePath[i] = spot_;
+  double dpvdspot = (bumpedPvs[0] - bumpedPvs[1]) / (2.0 * spotBump_);
+  double d2pvdspot2 = (bumpedPvs[0] - 2.0 * pv + bumpedPvs[1]) / (spotBump_ * spotBump_);
+  double dpvdvol = (bumpedPvs[2] - bumpedPvs[3]) / (2.0 * volBump_);
+
+  // the spot only enters the density of the first step of positive length, with
+  // score s = a / S_0 and second derivative of the density over the density (a^2 - b - a) / S_0^2
+  double a = z0 / stdevs_[firstStep_];
+  double b = 1.0 / (stdevs_[firstStep_] * stdevs_[firstStep_]);
+  double score = a / spot_;
+  greeks[0] = pv * score + dpvdspot;
+  greeks[1] = pv * (a * a - b - a) / (spot_ * spot_) + 2.0 * dpvdspot * score + d2pvdspot2;
+  greeks[2] = pv * vegaScore + dpvdvol;
+}
+
+double BsMcPricer::findImportanceShift()
+{
+  Vector const& fixtimes = prod_->fixTimes();
+  size_t ntimesteps = fixtimes.size();
+  double T = fixtimes[ntimesteps - 1];
+  if (T <= 0.0)
+    return 0.0;
+
+  // the objective as a function of the terminal deviate z = theta sqrt(T), evaluated on a copy
+  // of the product along the path with W_t = theta t
+  SPtrProduct prod = prod_->clone();
+  Matrix path(ntimesteps, 1);
+  const double ninf = -numeric_limits<double>::infinity();
+  auto objective = [&](double z) {
+    double theta = z / sqrt(T);
+    double x = log(spot_);
+    for (size_t i = 0; i < ntimesteps; ++i) {
+      x += drifts_[i] + stdevs_[i] * theta * sqrtdts_[i];
+      path(i, 0) = exp(x);
+    }
+    prod->eval(path);
+    Vector const& payamts = prod->payAmounts();
+    double pv = 0.0;
+    for (size_t i = 0; i < payamts.size(); ++i)
+      pv += discfactors_[i] * payamts[i];
+    return pv > 0.0 ? log(pv) - 0.5 * z * z : ninf;
+  };
+
+  // grid search over 8 standard deviations either side, then golden section search
+  // around the best grid point
+  const double h = 0.1;
+  double zbest = 0.0, fbest = ninf;
+  for (int k = -80; k <= 80; ++k) {
+    double f = objective(k * h);
+    if (f > fbest) {
+      fbest = f;
+      zbest = k * h;
+    }
+  }
+  if (fbest == ninf)
+    return 0.0;
+  const double g = 0.5 * (sqrt(5.0) - 1.0);
+  double a = zbest - h, b = zbest + h;
+  double c = b - g * (b - a), d = a + g * (b - a);
+  double fc = objective(c), fd = objective(d);
+  for (int iter = 0; iter < 30; ++iter) {
+    if (fc > fd) {
+      b = d;
+      d = c;
+      fd = fc;
+      c = b - g * (b - a);
+      fc = objective(c);
+    }
+    else {
+      a = c;
+      c = d;
+      fc = fd;
+      d = a + g * (b - a);
+      fd = objective(d);
+    }
+  }
+  double z = fc > fd ? c : d;
+  if (max(fc, fd) < fbest)
+    z = zbest;
+  return z / sqrt(T);
+}
+
+void BsMcPricer::shiftDeviates(Matrix& paths, Vector& lrweights) const
+{
+  // deviates z + mu under the shifted measure have the likelihood ratio exp(-mu.z - |mu|^2 / 2)
+  size_t npaths = paths.n_rows;
+  lrweights.set_size(npaths);
+  for (size_t p = 0; p < npaths; ++p)
+    lrweights[p] = -0.5 * isShiftNorm2_;
+  for (size_t i = 0; i < paths.n_cols; ++i) {
+    double mu = isShifts_[i];
+    double* z = paths.colptr(i);
+    for (size_t p = 0; p < npaths; ++p) {
+      lrweights[p] -= mu * z[p];
+      z[p] += mu;
+    }
+  }
+  expInPlace(lrweights.memptr(), npaths);
+}
+
+void BsMcPricer::estimateControlCoef()
+{
+  // pilot run over the first block of paths of the generator, on a copy of the product;
+  // the simulation continues after them, so that the coefficient does not depend on its paths
+  PathGenerator& pathgen = *pathgen_;
+  SPtrProduct prod = prod_->clone();
+  McWorkspace ws;
+  double sumy = 0.0, sumc = 0.0, sumcc = 0.0, sumyc = 0.0;
+  size_t n = 0;
+  for (; n < MC_PATHS_PER_BLOCK; n += MC_PATHS_PER_BATCH) {
+    processPaths(pathgen, *prod, ws, MC_PATHS_PER_BATCH);
+    for (size_t k = 0; k < MC_PATHS_PER_BATCH; ++k) {
+      double y = ws.pvs[k * nVariables()], c = ws.controlPvs[k] - ctrlPrice_;
+      sumy += y;
+      sumc += c;
+      sumcc += c * c;
+      sumyc += y * c;
+    }
+  }
+  double covyc = sumyc / n - (sumy / n) * (sumc / n);
+  double varc = sumcc / n - (sumc / n) * (sumc / n);
+  ctrlCoef_ = varc > 0.0 ? covyc / varc : 0.0;
+  ctrlCoefSet_ = true;
 }
 
 END_NAMESPACE(orf)
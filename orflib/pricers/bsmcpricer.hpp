@@ -8,14 +8,17 @@
 
 #include <orflib/products/product.hpp>
 #include <orflib/market/yieldcurve.hpp>
+#include <orflib/market/volatilitytermstructure.hpp>
 #include <orflib/methods/montecarlo/mcparams.hpp>
 #include <orflib/methods/montecarlo/pathgenerator.hpp>
-#include <orflib/methods/montecarlo/eulerpathgenerator.hpp>
+#include <orflib/methods/montecarlo/parallelsimulation.hpp>
 #include <orflib/math/stats/statisticscalculator.hpp>
 
 BEGIN_NAMESPACE(orf)
 
 /** Monte Carlo pricer in the Black-Scholes model (deterministic rates and vols).
+    The log spot steps exactly from fixing to fixing with the forward vols, see GbmSteps.
+    Supports the variance reductions, Greeks and single precision of McParams.
 */
 class BsMcPricer
 {
@@ -24,29 +27,108 @@ public:
   BsMcPricer(SPtrProduct prod,
              SPtrYieldCurve discountYieldCurve,
              double divYield,
-             double volatility,
+             SPtrVolatilityTermStructure volatility,
              double spot,
              McParams mcparams);
 
-  /** Returns the number of variables that can be tracked for stats */
-  size_t nVariables();
-
-  /** Runs the simulation and collects statistics */
+  /** Returns the number of variables that can be tracked for stats: the price, followed
+      with McParams::greeks by delta, gamma, vega and the rho to each forward rate of the discount curve
+      (see YieldCurve::nFwdRates), estimated in the same simulation. The vega is to a parallel shift
+      of the forward vols; with a constant vol, to the vol. The control variate only corrects the price.
+  */
+  size_t nVariables() const;
+
+  /** Runs the simulation and collects statistics.
+      The paths are distributed over McParams::nThreads threads;
+      the results do not depend on the number of threads.
+      With McParams::antithetic each sample is the average PV of a path and its mirror
+      image, so npaths samples take 2 * npaths price paths.
+      With McParams::nReplications > 1 each sample is the mean of one replication,
+      see simulateReplications. With a tolerance or a time budget in McParams, npaths is
+      the maximum number of paths, see simulateMc.
+      With a control variate, the first call first draws the pilot paths of the coefficient.
+      Returns the number of paths simulated and the elapsed time.
+  */
   template<typename ITER>
-  void simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths);
+  McRunInfo simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths);
 
 protected:
 
-  /** Creates and processes one price path.
-      It returns the PV of the product
-      */
-  double processOnePath(Matrix& pricePath);
+  /** Creates and processes the next npaths price paths with the passed-in generator and product.
+      The paths are generated as one block; the PVs are returned in ws.pvs
+  */
+  void processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const;
+
+  /** Like processPaths, for products with knock-out barriers: simulates path by path and
+      stops each path, drawing no more deviates, as soon as it is knocked out.
+      The surviving paths are streamed to the product, see Product::observeFixing;
+      only for products with Product::hasStreamingEval, and not with Greeks, which need the
+      paths knocked out by the product in full. The paths are in double precision.
+  */
+  void processPathsIncremental(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const;
+
+  /** Converts a block of normal deviates to prices, in place;
+      with McParams::singlePrecision in single precision, in ws.floatPaths, see
+      toPricesSinglePrecision for the error bounds. Single precision excludes the Greeks.
+  */
+  void toPrices(Matrix& paths, McWorkspace& ws) const;
+
+  /** Adds weight times the PVs of a block of price paths to ws.pvs, and likewise for the control.
+      Without Greeks the product evaluates the whole block at once, see Product::evalBlock.
+      With McParams::greeks, also adds the Greeks, using the Brownian motions in ws.brownians
+      times wsign (-1 for the mirror paths)
+  */
+  void addPVs(Product& prod, McWorkspace& ws, Matrix const& paths, double weight, double wsign) const;
+
+  /** Converts a block of normal deviates to the Brownian motion of each path at the fixing times,
+      one column per path
+  */
+  void toBrownians(Matrix const& paths, Matrix& brownians) const;
+
+  /** Returns in greeks the pathwise delta, gamma, vega and rhos of one path, given the payment
+      derivatives from Product::evalPathwise, the payment amounts and the path's Brownian motion w times wsign.
+      Delta, vega and the rhos come from one backward (adjoint) sweep along the path; gamma is the
+      pathwise delta times the likelihood ratio weight of the spot.
+  */
+  void pathwiseGreeks(McWorkspace& ws, Vector const& payamts,
+                      double const* w, double wsign, double* greeks) const;
+
+  /** Returns in greeks the likelihood ratio delta, gamma and vega of the path in ws.pricePath,
+      given its PV, its normal deviate at the first step of positive length and its vega score,
+      the sum over the time steps of ((z^2 - 1) / stdev - z) times the derivative of the stdev
+      of the step w.r.t. the forward vols, (z^2 - 1) / vol - z * sqrt(dt) with a constant vol.
+      Used for the products without pathwise derivatives, e.g. barriers, whose derivatives
+      through the bridge data (see Product::setBridgeData) are added by finite differences
+      on the same path.
+  */
+  void lrGreeks(McWorkspace& ws, double pv, double z0, double vegaScore, double* greeks) const;
+
+  /** Estimates the optimal control variate coefficient b = Cov(PV, control PV) / Var(control PV),
+      with the control variate priced in closed form, from a pilot run over the first block of
+      paths of the generator. The simulation does not reuse those paths, so the corrected
+      samples, PV - b * (control PV - control price), are unbiased.
+  */
+  void estimateControlCoef();
+
+  /** Finds the importance sampling drift theta, which maximizes log PV(theta) - theta^2 T / 2,
+      with PV(theta) the PV of the path along which the Brownian motion is W_t = theta t.
+      This is the most likely path among those that pay, within the paths of constant drift.
+      Returns 0 if the product pays on none of them. Called once, in the ctor.
+  */
+  double findImportanceShift();
+
+  /** Shifts a block of normal deviates by the importance sampling drift, in place,
+      and returns in lrweights the likelihood ratio of each path: the deviate of each time step
+      is shifted by theta * sqrt(dt), i.e. the Brownian motion gets the drift theta, and the
+      likelihood ratio is exp(-theta W_T - theta^2 T / 2). Importance sampling excludes the Greeks.
+  */
+  void shiftDeviates(Matrix& paths, Vector& lrweights) const;
 
 private:
   SPtrProduct prod_;      // pointer to the product
   SPtrYieldCurve discyc_; // pointer to the discount curve
   double divyld_;         // the constant dividend yield   
-  double vol_;            // the constant volatility
+  SPtrVolatilityTermStructure vol_;  // the volatility term structure
   double spot_;           // the initial spot
   McParams mcparams_;     // the Monte Carlo parameters
 
@@ -54,32 +136,54 @@ private:
   Vector discfactors_;         // caches the pre-computed discount factors
   Vector drifts_;              // caches the pre-computed asset drifts
   Vector stdevs_;              // caches the pre-computed standard deviations 
-
-  Vector payamts_;             // scratch array for writing the payments after each simulation
+  Vector sqrtdts_;             // caches the square roots of the time steps
+  Vector volDerivs_;           // the derivatives of the stdevs w.r.t. the forward vols, see GbmSteps::volDerivs
+  Matrix driftRateDerivs_;     // the derivatives of the drift of each time step w.r.t. the forward rates
+  Matrix discRateDerivs_;      // the derivatives of the discount factors w.r.t. the forward rates
+  size_t firstStep_;           // the first time step of positive length
+  std::vector<SPtrProduct> bridgeBumps_;  // the product with the bridge data of spot up, down, vol up, down
+  double spotBump_;            // the bump sizes of the bridge data
+  double volBump_;
+  Vector logLower_;            // the log knock-out barriers at each fixing, if any
+  Vector logUpper_;
+  Vector isShifts_;            // the importance sampling shift of the deviate of each time step, empty if none
+  double isShiftNorm2_;        // the sum of their squares
+
+  SPtrProduct ctrl_;                 // the control variate, if any
+  double ctrlPrice_;                 // its closed form price
+  double ctrlCoef_;                  // the control variate coefficient
+  bool ctrlCoefSet_;                 // true once the coefficient has been estimated
+  std::vector<size_t> ctrlFixIdx_;   // the product fixing index of each control fixing
+  Vector ctrlDiscfactors_;           // the discount factors of the control payments
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Inline definitions
 
 inline
-size_t BsMcPricer::nVariables()
+size_t BsMcPricer::nVariables() const
 {
-  return 1;
+  return mcparams_.greeks ? 4 + driftRateDerivs_.n_cols : 1;
 }
 
 template<typename ITER>
-void BsMcPricer::simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths)
+McRunInfo BsMcPricer::simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths)
 {
-  // create the price path matrix
-  Matrix pricePath(pathgen_->nTimeSteps(), pathgen_->nFactors());
   // check the size of the statistics calcuilator
-  ORF_ASSERT(statsCalc.nVariables() == nVariables(), "the statistics calculator must track only one variable!");
-
-  // This is the HOT loop
-  for (unsigned long i = 0; i < npaths; ++i) {
-    double pv = processOnePath(pricePath);
-    statsCalc.addSample(&pv, &pv + 1);
-  }
+  ORF_ASSERT(statsCalc.nVariables() == nVariables(), "the statistics calculator must track as many variables as the pricer captures!");
+
+  if (ctrl_ && !ctrlCoefSet_)
+    estimateControlCoef();
+
+  return simulateMc(statsCalc, pathgen_, prod_, npaths, mcparams_,
+    [this](PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t n) {
+      processPaths(pathgen, prod, ws, n);
+      if (ctrl_) {
+        size_t nvars = nVariables();
+        for (size_t k = 0; k < n; ++k)
+          ws.pvs[k * nvars] -= ctrlCoef_ * (ws.controlPvs[k] - ctrlPrice_);
+      }
+    });
 }
 
 END_NAMESPACE(orf)
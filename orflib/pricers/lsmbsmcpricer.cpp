@@ -0,0 +1,252 @@
+/**
+  @file  lsmbsmcpricer.cpp
+  @brief Implementation of the LsmBsMcPricer class
+*/
+
+#include <orflib/pricers/lsmbsmcpricer.hpp>
+#include <orflib/methods/montecarlo/pathgeneratorfactory.hpp>
+#include <orflib/methods/montecarlo/gbmsteps.hpp>
+#include <orflib/methods/montecarlo/momentmatching.hpp>
+
+#include <cmath>
+
+using namespace std;
+
+BEGIN_NAMESPACE(orf)
+
+namespace {
+
+  // copies the spots of path p at fixing time index i out of a block of price paths
+  inline void getSpots(Matrix const& paths, size_t p, size_t i, size_t ntimesteps, Vector& spots)
+  {
+    for (size_t j = 0; j < spots.size(); ++j)
+      spots[j] = paths(p, j * ntimesteps + i);
+  }
+
+}  // anonymous namespace
+
+LsmBsMcPricer::LsmBsMcPricer(SPtrProduct prod,
+                             SPtrYieldCurve discountCurve,
+                             Vector const& divYields,
+                             Vector const& volatilities,
+                             Vector const& spots,
+                             Matrix const& correlMatrix,
+                             McParams const& mcparams,
+                             size_t basisDegree)
+: prod_(prod->clone()), discyc_(discountCurve), divylds_(divYields), vols_(volatilities),
+spots_(spots), mcparams_(mcparams)
+{
+  // Get the simulation times
+  Vector const& fixtimes = prod->fixTimes();
+  size_t ntimesteps = fixtimes.size();
+  ORF_ASSERT(ntimesteps > 0, "LsmBsMcPricer: the product has no fixing times!");
+  ORF_ASSERT(prod->payTimes().size() == ntimesteps,
+             "LsmBsMcPricer: the product must have one payment time per fixing time!");
+
+  // Get the number of assets (factors) and check inputs for size.
+  size_t nassets = prod->nAssets();
+  ORF_ASSERT(divYields.size() == nassets, "need as many div yields as product assets!");
+  ORF_ASSERT(volatilities.size() == nassets, "need as many volatilities as product assets!");
+  ORF_ASSERT(spots.size() == nassets, "need as many spots as product assets!");
+  if (nassets > 1) {
+    ORF_ASSERT(correlMatrix.is_square(), "the correlation matrix must be square!");
+    ORF_ASSERT(correlMatrix.n_rows == nassets, "need as many correlation matrix rows as product assets!");
+  }
+
+  // Create the path generator, one factor per asset
+  pathgen_ = makePathGenerator(mcparams, fixtimes, nassets, correlMatrix);
+
+  // Pre-compute the discount factors
+  Vector const& paytimes = prod->payTimes();
+  discfactors_.resize(paytimes.size());
+  for (size_t i = 0; i < paytimes.size(); ++i)
+    discfactors_[i] = discyc_->discount(paytimes[i]);
+
+  // Pre-compute the stdevs and drifts from time step to time step, with each constant vol
+  // as a flat term structure; any positive maturity will do
+  drifts_.resize(ntimesteps, nassets);
+  stdevs_.resize(ntimesteps, nassets);
+  double tmat = fixtimes[ntimesteps - 1] > 0.0 ? fixtimes[ntimesteps - 1] : 1.0;
+  for (size_t j = 0; j < nassets; ++j) {
+    double vol = vols_[j];
+    SPtrVolatilityTermStructure flatvol(new VolatilityTermStructure(&tmat, &tmat + 1, &vol, &vol + 1));
+    GbmSteps steps(fixtimes, discyc_, divylds_[j], flatvol);
+    for (size_t i = 0; i < ntimesteps; ++i) {
+      drifts_(i, j) = steps.drifts()[i];
+      stdevs_(i, j) = steps.stdevs()[i];
+    }
+  }
+
+  // Enumerate the monomials up to basisDegree, each one as a monomial of one degree less
+  // times one scaled spot; the asset indices are non-decreasing, so that each monomial appears once
+  basisParent_.assign(1, 0);    // the constant
+  basisAsset_.assign(1, 0);
+  std::vector<size_t> firstAsset(1, 0);
+  size_t first = 0, last = 1;   // the monomials of the previous degree
+  for (size_t d = 1; d <= basisDegree; ++d) {
+    for (size_t k = first; k < last; ++k) {
+      for (size_t j = firstAsset[k]; j < nassets; ++j) {
+        basisParent_.push_back(k);
+        basisAsset_.push_back(j);
+        firstAsset.push_back(j);
+      }
+    }
+    first = last;
+    last = basisParent_.size();
+  }
+}
+
+void LsmBsMcPricer::regress(unsigned long nregpaths)
+{
+  ORF_ASSERT(nregpaths > 0, "LsmBsMcPricer: need at least one regression path!");
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  size_t nbasis = nBasisFunctions();
+  Vector const& fixtimes = prod_->fixTimes();
+
+  // Simulate and store the regression paths, mirror images after the originals
+  Matrix paths;
+  pathgen_->nextBlock(nregpaths, paths);
+  if (mcparams_.momentMatching)
+    matchMoments(paths);
+  if (mcparams_.antithetic) {
+    Matrix both(2 * paths.n_rows, paths.n_cols);
+    for (size_t c = 0; c < paths.n_cols; ++c)
+      for (size_t p = 0; p < paths.n_rows; ++p) {
+        both(p, c) = paths(p, c);
+        both(paths.n_rows + p, c) = -paths(p, c);
+      }
+    paths = both;
+  }
+  toPrices(paths);
+  size_t nrows = paths.n_rows;
+
+  // The PV of the cash flow of each path under the exercise policy found so far,
+  // starting with the payoff at expiration
+  Vector spots(nassets), basis(nbasis);
+  Vector cashPVs(nrows);
+  for (size_t p = 0; p < nrows; ++p) {
+    getSpots(paths, p, ntimesteps - 1, ntimesteps, spots);
+    cashPVs[p] = discfactors_[ntimesteps - 1] * prod_->exerciseValue(ntimesteps - 1, spots);
+  }
+
+  coefs_.zeros(nbasis, ntimesteps);
+  exercisable_.assign(ntimesteps, false);
+  std::vector<size_t> itmPaths;
+  std::vector<double> itmValues;
+  Matrix X;
+  Vector y, coef;
+  // Backward induction over the fixing times before expiration
+  for (size_t ii = ntimesteps - 1; ii > 0; --ii) {
+    size_t i = ii - 1;
+    itmPaths.clear();
+    itmValues.clear();
+    for (size_t p = 0; p < nrows; ++p) {
+      getSpots(paths, p, i, ntimesteps, spots);
+      double exval = prod_->exerciseValue(i, spots);
+      if (exval > 0.0) {
+        itmPaths.push_back(p);
+        itmValues.push_back(exval);
+      }
+    }
+    size_t nitm = itmPaths.size();
+    // at t = 0 all paths share the initial spots and only the constant can be fitted
+    size_t nfit = fixtimes[i] > 0.0 ? nbasis : 1;
+    if (nitm < nfit)
+      continue;
+
+    // Regress the continuation values, as of this fixing time, on the basis functions
+    X.set_size(nitm, nfit);
+    y.set_size(nitm);
+    for (size_t k = 0; k < nitm; ++k) {
+      size_t p = itmPaths[k];
+      getSpots(paths, p, i, ntimesteps, spots);
+      evalBasis(spots, basis);
+      for (size_t b = 0; b < nfit; ++b)
+        X(k, b) = basis[b];
+      y[k] = cashPVs[p] / discfactors_[i];
+    }
+    if (!arma::solve(coef, X, y))
+      continue;
+    exercisable_[i] = true;
+    for (size_t b = 0; b < nfit; ++b)
+      coefs_(b, i) = coef[b];
+
+    // Exercise where it is worth more than continuing
+    for (size_t k = 0; k < nitm; ++k) {
+      double contval = 0.0;
+      for (size_t b = 0; b < nfit; ++b)
+        contval += X(k, b) * coef[b];
+      if (itmValues[k] > contval)
+        cashPVs[itmPaths[k]] = discfactors_[i] * itmValues[k];
+    }
+  }
+
+  // Keep one PV per sample
+  size_t nsamples = nregpaths;
+  regressionPvs_.set_size(nsamples);
+  for (size_t p = 0; p < nsamples; ++p)
+    regressionPvs_[p] = mcparams_.antithetic ? 0.5 * (cashPVs[p] + cashPVs[nsamples + p]) : cashPVs[p];
+}
+
+void LsmBsMcPricer::processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const
+{
+  pathgen.nextBlock(npaths, ws.paths);
+  if (mcparams_.momentMatching)
+    matchMoments(ws.paths);
+  if (mcparams_.antithetic)
+    mirrorDeviates(ws.paths, ws.mirrorPaths);
+
+  Vector spots(drifts_.n_cols), basis(nBasisFunctions());
+  ws.pvs.set_size(npaths);
+  toPrices(ws.paths);
+  for (size_t p = 0; p < npaths; ++p)
+    ws.pvs[p] = pathPV(prod, ws.paths, p, spots, basis);
+  if (mcparams_.antithetic) {
+    toPrices(ws.mirrorPaths);
+    for (size_t p = 0; p < npaths; ++p)
+      ws.pvs[p] = 0.5 * (ws.pvs[p] + pathPV(prod, ws.mirrorPaths, p, spots, basis));
+  }
+}
+
+void LsmBsMcPricer::toPrices(Matrix& paths) const
+{
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  for (size_t j = 0; j < nassets; ++j)
+    toGbmPrices(paths.colptr(j * ntimesteps), paths.n_rows, ntimesteps, spots_[j],
+                drifts_.colptr(j), stdevs_.colptr(j));
+}
+
+void LsmBsMcPricer::evalBasis(Vector const& spots, Vector& basis) const
+{
+  basis[0] = 1.0;
+  for (size_t k = 1; k < basisParent_.size(); ++k) {
+    size_t j = basisAsset_[k];
+    basis[k] = basis[basisParent_[k]] * spots[j] / spots_[j];
+  }
+}
+
+double LsmBsMcPricer::pathPV(Product& prod, Matrix const& paths, size_t p, Vector& spots, Vector& basis) const
+{
+  size_t ntimesteps = drifts_.n_rows;
+  // walk forward until the first fixing time where exercising beats continuing
+  for (size_t i = 0; i < ntimesteps - 1; ++i) {
+    if (!exercisable_[i])
+      continue;
+    getSpots(paths, p, i, ntimesteps, spots);
+    double exval = prod.exerciseValue(i, spots);
+    if (exval <= 0.0)
+      continue;
+    evalBasis(spots, basis);
+    double contval = 0.0;
+    for (size_t b = 0; b < basis.size(); ++b)
+      contval += basis[b] * coefs_(b, i);
+    if (exval > contval)
+      return discfactors_[i] * exval;
+  }
+  getSpots(paths, p, ntimesteps - 1, ntimesteps, spots);
+  return discfactors_[ntimesteps - 1] * prod.exerciseValue(ntimesteps - 1, spots);
+}
+
+END_NAMESPACE(orf)
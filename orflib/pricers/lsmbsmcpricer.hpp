@@ -0,0 +1,166 @@
+/**
+@file  lsmbsmcpricer.hpp
+@brief Least-squares Monte Carlo pricer for products with early exercise, in the Black Scholes model
+*/
+
+#ifndef ORF_LSMBSMCPRICER_HPP
+#define ORF_LSMBSMCPRICER_HPP
+
+#include <orflib/products/product.hpp>
+#include <orflib/market/yieldcurve.hpp>
+#include <orflib/methods/montecarlo/mcparams.hpp>
+#include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/methods/montecarlo/parallelsimulation.hpp>
+#include <orflib/math/stats/statisticscalculator.hpp>
+
+#include <vector>
+
+BEGIN_NAMESPACE(orf)
+
+/** Longstaff-Schwartz Monte Carlo pricer for products with early exercise, in the
+    multiasset Black-Scholes model (deterministic rates and vols, one yield curve for all assets).
+    The product can be exercised at each of its fixing times; the value of exercising at
+    fixing time index i is Product::exerciseValue(i, spots), the intrinsic value, paid at payTimes()[i].
+    At the last fixing time the product pays its payoff.
+
+    The continuation value at each fixing time is regressed, over the in-the-money paths,
+    on the monomials up to total degree basisDegree of the spots scaled by the initial spots.
+    Pricing is done in two passes:
+    - regress() simulates and stores the regression paths and runs the backward induction;
+    - simulate() streams fresh paths in blocks, exercising each one at the first fixing where
+      the exercise value exceeds the regressed continuation value. This estimate is biased low.
+    Alternatively, simulateRegressionPaths() collects the PVs of the regression paths
+    themselves, in one pass. This estimate is biased high.
+    Supports antithetic sampling and moment matching; McParams::controlVariate is ignored.
+*/
+class LsmBsMcPricer
+{
+public:
+  /** Initializing ctor */
+  LsmBsMcPricer(SPtrProduct prod,
+                SPtrYieldCurve discountYieldCurve,
+                Vector const& divYields,
+                Vector const& volatilities,
+                Vector const& spots,
+                Matrix const& correlMatrix,
+                McParams const& mcparams,
+                size_t basisDegree = 3);
+
+  /** Returns the number of variables that can be tracked for stats */
+  size_t nVariables();
+
+  /** Returns the number of regression basis functions */
+  size_t nBasisFunctions() const;
+
+  /** Runs the regression pass on nregpaths paths. The paths are stored as prices,
+      one column per asset and fixing time, for the backward induction; afterwards only
+      the regression coefficients and the PVs of the paths are kept.
+      With McParams::antithetic the mirror paths are also used for the regression.
+  */
+  void regress(unsigned long nregpaths);
+
+  /** Returns the regression coefficients, one column per fixing time */
+  Matrix const& regressionCoefs() const;
+
+  /** Runs the pricing pass on npaths new paths and collects statistics.
+      regress() must have been called first. The paths are generated, priced and
+      discarded one batch at a time, distributed over McParams::nThreads threads;
+      the results do not depend on the number of threads.
+      With McParams::nReplications > 1 each sample is the mean of one replication,
+      see simulateReplications. With a tolerance or a time budget in McParams, npaths is
+      the maximum number of paths, see simulateMc.
+      Returns the number of paths simulated and the elapsed time.
+  */
+  template<typename ITER>
+  McRunInfo simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths);
+
+  /** Collects statistics of the PVs of the paths of the last regression pass */
+  template<typename ITER>
+  void simulateRegressionPaths(StatisticsCalculator<ITER>& statsCalc);
+
+protected:
+
+  /** Creates and prices the next npaths paths with the passed-in generator and product.
+      The PVs are returned in ws.pvs
+  */
+  void processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const;
+
+  /** Converts a block of normal deviates to prices, in place */
+  void toPrices(Matrix& paths) const;
+
+  /** Evaluates the basis functions at the passed-in spots */
+  void evalBasis(Vector const& spots, Vector& basis) const;
+
+  /** Returns the PV of the p-th path of a block of price paths,
+      exercised with the regressed continuation values
+  */
+  double pathPV(Product& prod, Matrix const& paths, size_t p, Vector& spots, Vector& basis) const;
+
+private:
+  SPtrProduct prod_;               // pointer to the product
+  SPtrYieldCurve discyc_;          // pointer to the discount curve
+  Vector divylds_;                 // the constant dividend yield, one per asset
+  Vector vols_;                    // the constant volatility, one per asset
+  Vector spots_;                   // the initial spots, one per asset
+  McParams mcparams_;              // the Monte Carlo parameters
+
+  SPtrPathGenerator pathgen_;  // pointer to the path generator
+  Vector discfactors_;         // caches the pre-computed discount factors
+  Matrix drifts_;              // caches the pre-computed asset drifts, one column per asset
+  Matrix stdevs_;              // caches the pre-computed standard deviations, one column per asset
+
+  // basis function k > 0 is basis function basisParent_[k] times the scaled spot of asset basisAsset_[k]
+  std::vector<size_t> basisParent_;
+  std::vector<size_t> basisAsset_;
+  Matrix coefs_;                   // the regression coefficients, one column per fixing time
+  std::vector<bool> exercisable_;  // false at fixing times with too few paths in the money to regress
+  Vector regressionPvs_;           // the PVs of the regression paths
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+inline
+size_t LsmBsMcPricer::nVariables()
+{
+  return 1;  // just one variable, the price
+}
+
+inline
+size_t LsmBsMcPricer::nBasisFunctions() const
+{
+  return basisParent_.size();
+}
+
+inline
+Matrix const& LsmBsMcPricer::regressionCoefs() const
+{
+  return coefs_;
+}
+
+template<typename ITER>
+McRunInfo LsmBsMcPricer::simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths)
+{
+  // check the size of the statistics calculator
+  ORF_ASSERT(statsCalc.nVariables() == nVariables(), "the statistics calculator must track as many variables as the pricer captures!");
+  ORF_ASSERT(coefs_.n_cols > 0, "LsmBsMcPricer: regress() must be called before simulate()!");
+
+  return simulateMc(statsCalc, pathgen_, prod_, npaths, mcparams_,
+    [this](PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t n) {
+      processPaths(pathgen, prod, ws, n);
+    });
+}
+
+template<typename ITER>
+void LsmBsMcPricer::simulateRegressionPaths(StatisticsCalculator<ITER>& statsCalc)
+{
+  ORF_ASSERT(statsCalc.nVariables() == nVariables(), "the statistics calculator must track as many variables as the pricer captures!");
+  ORF_ASSERT(coefs_.n_cols > 0, "LsmBsMcPricer: regress() must be called before simulateRegressionPaths()!");
+
+  for (size_t p = 0; p < regressionPvs_.size(); ++p)
+    statsCalc.addSample(&regressionPvs_[p], &regressionPvs_[p] + 1);
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_LSMBSMCPRICER_HPP
@@ -0,0 +1,251 @@
+/**
+@file  mlmcbsmcpricer.cpp
+@brief Implementation of the MlmcBsMcPricer class
+*/
+
+#include <orflib/pricers/mlmcbsmcpricer.hpp>
+#include <orflib/methods/montecarlo/pathgeneratorfactory.hpp>
+#include <orflib/methods/montecarlo/gbmsteps.hpp>
+#include <orflib/methods/montecarlo/momentmatching.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+BEGIN_NAMESPACE(orf)
+
+MlmcBsMcPricer::MlmcBsMcPricer(SPtrProduct prod,
+                               SPtrYieldCurve discountCurve,
+                               double divYield,
+                               SPtrVolatilityTermStructure volatility,
+                               double spot,
+                               McParams mcparams)
+: discyc_(discountCurve), divyld_(divYield), vol_(volatility), spot_(spot), mcparams_(mcparams)
+{
+  BarrierCallPut const* barr = dynamic_cast<BarrierCallPut const*>(prod.get());
+  ORF_ASSERT(barr, "MlmcBsMcPricer: the product must be a BarrierCallPut!");
+  ORF_ASSERT(mcparams.nReplications <= 1, "MlmcBsMcPricer: the simulation cannot be split in replications!");
+
+  // the coarse levels: the frequencies below the fixing frequency of the product
+  // with at least one fixing before expiration
+  double T = barr->timeToExp();
+  double finefreq = BarrierCallPut::freqPerYear(barr->fixingFreq());
+  vector<SPtrProduct> prods;
+  BarrierCallPut::Freq freqs[] = { BarrierCallPut::Freq::MONTHLY, BarrierCallPut::Freq::WEEKLY,
+                                   BarrierCallPut::Freq::DAILY };
+  for (BarrierCallPut::Freq freq : freqs) {
+    double nfreq = BarrierCallPut::freqPerYear(freq);
+    if (nfreq >= finefreq)
+      break;
+    if (T * nfreq < 1.0)
+      continue;
+    prods.push_back(SPtrProduct(new BarrierCallPut(barr->payoffType(), barr->strike(), T, barr->upOrDown(),
+                                                   barr->barrier(), freq, barr->monitoringFreq())));
+  }
+  // the finest level is the product itself; on a copy, since it gets the bridge data
+  prods.push_back(prod->clone());
+
+  for (size_t l = 0; l < prods.size(); ++l)
+    addLevel(prods[l], l > 0 ? prods[l - 1] : SPtrProduct());
+}
+
+void MlmcBsMcPricer::addLevel(SPtrProduct fine, SPtrProduct coarse)
+{
+  Level lev(mcSampleGroupSize(mcparams_));
+  lev.fine = fine;
+  lev.coarse = coarse;
+
+  // the time steps are the union of the fixing times of both products
+  Vector const& finefix = fine->fixTimes();
+  vector<double> times(finefix.begin(), finefix.end());
+  if (coarse) {
+    Vector const& coarsefix = coarse->fixTimes();
+    times.insert(times.end(), coarsefix.begin(), coarsefix.end());
+    sort(times.begin(), times.end());
+    times.erase(unique(times.begin(), times.end()), times.end());
+  }
+  auto locate = [&times](Vector const& fixtimes, vector<size_t>& idx) {
+    idx.resize(fixtimes.n_elem);
+    for (size_t k = 0; k < fixtimes.n_elem; ++k)
+      idx[k] = lower_bound(times.begin(), times.end(), fixtimes[k]) - times.begin();
+  };
+  locate(finefix, lev.fineIdx);
+  if (coarse)
+    locate(coarse->fixTimes(), lev.coarseIdx);
+
+  // Pre-compute the stdevs and drifts from time step to time step
+  GbmSteps steps(Vector(times), discyc_, divyld_, vol_);
+  lev.drifts = steps.drifts();
+  lev.stdevs = steps.stdevs();
+
+  // Pre-compute the discount factors
+  Vector const& finepay = fine->payTimes();
+  lev.fineDiscfactors.resize(finepay.size());
+  for (size_t i = 0; i < finepay.size(); ++i)
+    lev.fineDiscfactors[i] = discyc_->discount(finepay[i]);
+  if (coarse) {
+    Vector const& coarsepay = coarse->payTimes();
+    lev.coarseDiscfactors.resize(coarsepay.size());
+    for (size_t i = 0; i < coarsepay.size(); ++i)
+      lev.coarseDiscfactors[i] = discyc_->discount(coarsepay[i]);
+  }
+
+  // Pass the initial spot and the log variances between its fixings, the sums of those of the
+  // time steps in between, to the product of the level; the coarse one is the product of the
+  // level below and has them already
+  Vector spots(1);
+  spots[0] = spot_;
+  Matrix logvars(finefix.n_elem, 1);
+  for (size_t k = 0; k < finefix.n_elem; ++k) {
+    logvars(k, 0) = 0.0;
+    for (size_t i = k > 0 ? lev.fineIdx[k - 1] + 1 : 0; i <= lev.fineIdx[k]; ++i)
+      logvars(k, 0) += lev.stdevs[i] * lev.stdevs[i];
+  }
+  fine->setBridgeData(spots, logvars);
+
+  // one factor to simulate the spot, on a stream of its own
+  lev.pathgen = makePathGenerator(mcparams_, Vector(times), 1);
+  lev.pathgen->seed(static_cast<unsigned long>(levels_.size() + 1));
+  levels_.push_back(lev);
+}
+
+McRunInfo MlmcBsMcPricer::simulate(double rmse)
+{
+  ORF_ASSERT(rmse > 0.0, "MlmcBsMcPricer: the target standard error must be positive!");
+  auto start = chrono::steady_clock::now();
+  auto elapsed = [&start]() {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  };
+  McRunInfo info = { 0, 0.0, false };
+
+  size_t nlevels = levels_.size();
+  vector<unsigned long> nround(nlevels, 0);
+  for (size_t l = 0; l < nlevels; ++l)
+    if (levels_[l].npaths == 0)
+      nround[l] = MC_PATHS_FIRST_ROUND;
+
+  while (true) {
+    for (size_t l = 0; l < nlevels; ++l) {
+      simulateLevel(l, nround[l]);
+      info.npaths += nround[l];
+    }
+    if (stdError() <= rmse) {
+      info.converged = true;
+      break;
+    }
+    if (mcparams_.maxSeconds > 0.0 && elapsed() >= mcparams_.maxSeconds)
+      break;
+
+    // the optimal number of paths of each level, for the cost of the samples
+    double sum = 0.0;
+    for (size_t l = 0; l < nlevels; ++l)
+      sum += sqrt(levels_[l].variance * levelCost(l));
+    unsigned long total = 0;
+    for (size_t l = 0; l < nlevels; ++l) {
+      Level const& lev = levels_[l];
+      double needed = sqrt(lev.variance / levelCost(l)) * sum / (rmse * rmse) - lev.npaths;
+      unsigned long next = needed <= 0.0 ? 0
+        : needed < lev.npaths ? static_cast<unsigned long>(needed) : lev.npaths;
+      nround[l] = (next + MC_PATHS_PER_BLOCK - 1) / MC_PATHS_PER_BLOCK * MC_PATHS_PER_BLOCK;
+      total += nround[l];
+    }
+    if (total == 0) {
+      // only by rounding: one block more where the variance of the mean is largest
+      size_t lmax = 0;
+      for (size_t l = 1; l < nlevels; ++l)
+        if (levels_[l].variance / levels_[l].npaths > levels_[lmax].variance / levels_[lmax].npaths)
+          lmax = l;
+      nround[lmax] = MC_PATHS_PER_BLOCK;
+    }
+  }
+  info.seconds = elapsed();
+  return info;
+}
+
+double MlmcBsMcPricer::price() const
+{
+  double sum = 0.0;
+  for (Level const& lev : levels_)
+    sum += lev.mean;
+  return sum;
+}
+
+double MlmcBsMcPricer::stdError() const
+{
+  double var = 0.0;
+  for (Level const& lev : levels_)
+    if (lev.npaths > 0)
+      var += lev.variance / lev.npaths;
+  return sqrt(var);
+}
+
+void MlmcBsMcPricer::simulateLevel(size_t l, unsigned long npaths)
+{
+  if (npaths == 0)
+    return;
+  Level& lev = levels_[l];
+  simulateInParallel(lev.stats, lev.pathgen, lev.fine, npaths, mcparams_.nThreads,
+    [this, l](PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t n) {
+      processPaths(l, pathgen, prod, ws, n);
+    });
+  lev.npaths += npaths;
+  Matrix const& results = lev.stats.results();
+  lev.mean = results(0, 0);
+  lev.variance = results(1, 0);
+}
+
+void MlmcBsMcPricer::processPaths(size_t l, PathGenerator& pathgen, Product& prod, McWorkspace& ws,
+                                  size_t npaths) const
+{
+  Level const& lev = levels_[l];
+  pathgen.nextBlock(npaths, ws.paths);
+  if (mcparams_.momentMatching)
+    matchMoments(ws.paths);
+  if (mcparams_.antithetic)
+    mirrorDeviates(ws.paths, ws.mirrorPaths);
+
+  ws.pvs.zeros(npaths);
+  // this thread's copy of the coarse product
+  if (lev.coarse && !ws.control)
+    ws.control = lev.coarse->clone();
+  double weight = mcparams_.antithetic ? 0.5 : 1.0;
+  toPrices(lev, ws.paths);
+  addPVs(lev, prod, ws, ws.paths, weight);
+  if (mcparams_.antithetic) {
+    toPrices(lev, ws.mirrorPaths);
+    addPVs(lev, prod, ws, ws.mirrorPaths, weight);
+  }
+}
+
+void MlmcBsMcPricer::toPrices(Level const& lev, Matrix& paths) const
+{
+  toGbmPrices(paths.memptr(), paths.n_rows, paths.n_cols, spot_, lev.drifts.memptr(), lev.stdevs.memptr());
+}
+
+void MlmcBsMcPricer::addPVs(Level const& lev, Product& fine, McWorkspace& ws, Matrix const& paths,
+                            double weight) const
+{
+  // each product sees its fixings only, gathered from the block
+  size_t npaths = paths.n_rows;
+  auto gather = [&paths, npaths](vector<size_t> const& idx, Matrix& block) {
+    block.set_size(npaths, idx.size());
+    for (size_t i = 0; i < idx.size(); ++i)
+      std::copy(paths.colptr(idx[i]), paths.colptr(idx[i]) + npaths, block.colptr(i));
+  };
+  gather(lev.fineIdx, ws.pricePath);
+  fine.evalBlock(ws.pricePath, lev.fineDiscfactors, ws.blockPvs);
+  for (size_t p = 0; p < npaths; ++p)
+    ws.pvs[p] += weight * ws.blockPvs[p];
+
+  // the same paths as seen by the coarse product
+  if (lev.coarse) {
+    gather(lev.coarseIdx, ws.controlPath);
+    ws.control->evalBlock(ws.controlPath, lev.coarseDiscfactors, ws.blockPvs);
+    for (size_t p = 0; p < npaths; ++p)
+      ws.pvs[p] -= weight * ws.blockPvs[p];
+  }
+}
+
+END_NAMESPACE(orf)
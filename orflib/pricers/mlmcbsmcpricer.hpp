@@ -0,0 +1,160 @@
+/**
+@file  mlmcbsmcpricer.hpp
+@brief Multilevel Monte Carlo pricer of discretely monitored barrier options in the Black Scholes model
+*/
+
+#ifndef ORF_MLMCBSMCPRICER_HPP
+#define ORF_MLMCBSMCPRICER_HPP
+
+#include <orflib/products/barriercallput.hpp>
+#include <orflib/market/yieldcurve.hpp>
+#include <orflib/market/volatilitytermstructure.hpp>
+#include <orflib/methods/montecarlo/mcparams.hpp>
+#include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/methods/montecarlo/parallelsimulation.hpp>
+#include <orflib/math/stats/stratifiedmeanvarcalculator.hpp>
+
+#include <vector>
+
+BEGIN_NAMESPACE(orf)
+
+/** Multilevel Monte Carlo pricer of a BarrierCallPut in the Black-Scholes model
+    (deterministic rates and vols), see M. B. Giles, "Multilevel Monte Carlo path simulation",
+    Operations Research 56 (2008).
+    The levels are the option with monthly, weekly and daily fixings, up to the fixing frequency
+    of the product, which is the finest level. All levels monitor the barrier at the product's
+    monitoring frequency, with the Brownian bridge between their fixings (see BarrierCallPut),
+    so that the coarse levels are cheap approximations of the product. The price is the sum of
+    the mean PV of level 0 and the mean corrections P_l - P_{l-1} of the finer levels; since the
+    finest level is the product itself, it has no bias beyond that of the single level estimator.
+    A sample of a correction evaluates both levels on one path, simulated on the union of
+    their fixing times, so that they share the same Brownian increments and the correction
+    has a small variance. The levels draw from independent streams: the path generator of
+    level l is seeded with l + 1.
+    Supports antithetic sampling, moment matching and stratification, see McParams.
+*/
+class MlmcBsMcPricer
+{
+public:
+  /** Initializing ctor; the product must be a BarrierCallPut */
+  MlmcBsMcPricer(SPtrProduct prod,
+                 SPtrYieldCurve discountYieldCurve,
+                 double divYield,
+                 SPtrVolatilityTermStructure volatility,
+                 double spot,
+                 McParams mcparams);
+
+  /** Returns the number of levels */
+  size_t nLevels() const;
+
+  /** Runs the simulation until the standard error of the price is at most rmse, or until
+      McParams::maxSeconds have elapsed. Every level starts with MC_PATHS_FIRST_ROUND paths.
+      Then, with V_l the sample variance and C_l the number of time steps of a sample of level l,
+      level l is given N_l = sqrt(V_l / C_l) sum_k sqrt(V_k C_k) / rmse^2 paths, which minimizes
+      the total number of time steps for the requested standard error; the extra paths of a round
+      are in whole blocks and at most as many as were simulated so far, per level.
+      Can be called again, with a smaller rmse, to refine the estimate.
+      Returns the number of paths simulated over all levels and the elapsed time.
+  */
+  McRunInfo simulate(double rmse);
+
+  /** Returns the price, the sum of the level means */
+  double price() const;
+
+  /** Returns the standard error of the price */
+  double stdError() const;
+
+  /** Returns the number of paths simulated so far at level l */
+  unsigned long nPaths(size_t l) const;
+
+  /** Returns the mean and the variance of the samples of level l */
+  double levelMean(size_t l) const;
+  double levelVariance(size_t l) const;
+
+  /** Returns the number of time steps of one sample of level l */
+  size_t levelCost(size_t l) const;
+
+protected:
+
+  /** Creates the next npaths paths of level l with the passed-in generator and returns in ws.pvs
+      the PV of the product prod of the level, less that of the coarse one for l > 0
+  */
+  void processPaths(size_t l, PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const;
+
+private:
+  struct Level
+  {
+    SPtrProduct fine;                   // the option with the fixings of this level
+    SPtrProduct coarse;                 // the option of the level below, empty for level 0
+    SPtrPathGenerator pathgen;          // simulates the union of the fixing times of both
+    Vector drifts;                      // the log spot drift of each time step
+    Vector stdevs;                      // the log spot standard deviation of each time step
+    std::vector<size_t> fineIdx;        // the time step of each fixing of fine
+    std::vector<size_t> coarseIdx;      // the time step of each fixing of coarse
+    Vector fineDiscfactors;             // the discount factors of the payments of fine
+    Vector coarseDiscfactors;           // the discount factors of the payments of coarse
+    StratifiedMeanVarCalculator<double*> stats;   // the samples of this level
+    unsigned long npaths;               // the number of samples so far
+    double mean;                        // their mean and variance, as of the last round
+    double variance;
+
+    Level(size_t groupsize) : stats(1, groupsize), npaths(0), mean(0.0), variance(0.0) {}
+  };
+
+  // Runs npaths more paths of level l and updates its mean and variance
+  void simulateLevel(size_t l, unsigned long npaths);
+
+  // Creates a level over the union of the fixing times of fine and coarse (if any)
+  void addLevel(SPtrProduct fine, SPtrProduct coarse);
+
+  // Converts a block of normal deviates of level l to prices, in place
+  void toPrices(Level const& lev, Matrix& paths) const;
+
+  // Adds weight times the PVs of a block of price paths of level l to ws.pvs
+  void addPVs(Level const& lev, Product& fine, McWorkspace& ws, Matrix const& paths, double weight) const;
+
+  SPtrYieldCurve discyc_; // pointer to the discount curve
+  double divyld_;         // the constant dividend yield
+  SPtrVolatilityTermStructure vol_;  // the volatility term structure
+  double spot_;           // the initial spot
+  McParams mcparams_;     // the Monte Carlo parameters
+
+  std::vector<Level> levels_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+inline
+size_t MlmcBsMcPricer::nLevels() const
+{
+  return levels_.size();
+}
+
+inline
+unsigned long MlmcBsMcPricer::nPaths(size_t l) const
+{
+  return levels_[l].npaths;
+}
+
+inline
+double MlmcBsMcPricer::levelMean(size_t l) const
+{
+  return levels_[l].mean;
+}
+
+inline
+double MlmcBsMcPricer::levelVariance(size_t l) const
+{
+  return levels_[l].variance;
+}
+
+inline
+size_t MlmcBsMcPricer::levelCost(size_t l) const
+{
+  return levels_[l].drifts.n_elem;
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_MLMCBSMCPRICER_HPP
@@ -4,7 +4,11 @@
 */
 
 #include <orflib/pricers/multiassetbsmcpricer.hpp>
-#include <orflib/methods/montecarlo/eulerpathgenerator.hpp>
+#include <orflib/methods/montecarlo/pathgeneratorfactory.hpp>
+#include <orflib/methods/montecarlo/gbmsteps.hpp>
+#include <orflib/methods/montecarlo/momentmatching.hpp>
+#include <orflib/methods/montecarlo/singleprecisionpaths.hpp>
+#include <orflib/math/vectormath.hpp>
 
 #include <cmath>
 
@@ -15,7 +19,7 @@ BEGIN_NAMESPACE(orf)
 MultiAssetBsMcPricer::MultiAssetBsMcPricer(SPtrProduct prod,
                                            SPtrYieldCurve discountCurve,
                                            Vector const& divYields,
-                                           Vector const& volatilities,
+                                           std::vector<SPtrVolatilityTermStructure> const& volatilities,
                                            Vector const& spots,
                                            Matrix const& correlMatrix,
                                            McParams const& mcparams)
@@ -36,28 +40,11 @@ spots_(spots), mcparams_(mcparams)
     ORF_ASSERT(correlMatrix.n_rows == nassets, "need as many correlation matrix rows as product assets!");
   }
 
-  // Create the path generator, one factor to simulate the spot
-  if (mcparams.pathGenType == McParams::PathGenType::EULER) {
-    if (mcparams.urngType == McParams::UrngType::MINSTDRAND)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngMinStdRand>(
-        timesteps.begin(), timesteps.end(), nassets, correlMatrix));
-    else if (mcparams.urngType == McParams::UrngType::MT19937)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngMt19937>(
-        timesteps.begin(), timesteps.end(), nassets, correlMatrix));
-    else if (mcparams.urngType == McParams::UrngType::RANLUX3)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngRanLux3>(
-        timesteps.begin(), timesteps.end(), nassets, correlMatrix));
-    else if (mcparams.urngType == McParams::UrngType::RANLUX4)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngRanLux4>(
-        timesteps.begin(), timesteps.end(), nassets, correlMatrix));
-    else if (mcparams.urngType == McParams::UrngType::SOBOL)
-      pathgen_ = SPtrPathGenerator(new EulerPathGenerator<NormalRngSobol>(
-        timesteps.begin(), timesteps.end(), nassets, correlMatrix));
-    else
-      ORF_ASSERT(0, "unknown urng type!");
-  }
-  else
-    ORF_ASSERT(0, "unknown path generator type!");
+  ORF_ASSERT(!mcparams.greeks || !mcparams.singlePrecision,
+    "MultiAssetBsMcPricer: the Greeks need double precision paths!");
+
+  // Create the path generator, one factor per asset
+  pathgen_ = makePathGenerator(mcparams, timesteps, nassets, correlMatrix);
 
   // Pre-compute the discount factors
   Vector const& paytimes = prod->payTimes();
@@ -69,48 +56,222 @@ spots_(spots), mcparams_(mcparams)
   Vector const& fixtimes = prod->fixTimes();
   drifts_.resize(fixtimes.size(), nassets);
   stdevs_.resize(fixtimes.size(), nassets);
+  volDerivs_.resize(fixtimes.size(), nassets);
 
   // loop over assets
   for (size_t j = 0; j < nassets; ++j) {
+    GbmSteps steps(fixtimes, discyc_, divylds_[j], vols_[j]);
+    for (size_t i = 0; i < fixtimes.size(); ++i) {
+      drifts_(i, j) = steps.drifts()[i];
+      stdevs_(i, j) = steps.stdevs()[i];
+      volDerivs_(i, j) = steps.volDerivs()[i];
+    }
+  }
+
+  // For the adjoint Greeks, the derivatives of the drifts and of the discount factors
+  // with respect to the forward rates of the curve; they do not depend on the path
+  if (mcparams.greeks) {
+    size_t nrates = discyc_->nFwdRates();
+    Vector derivs;
+    driftRateDerivs_.zeros(fixtimes.size(), nrates);
     double t1 = 0.0;
-    // loop over fixing times
     for (size_t i = 0; i < fixtimes.size(); ++i) {
       double t2 = fixtimes[i];
-      double var = vols_[j] * vols_[j] * (t2 - t1);
-      stdevs_(i, j) = vols_[j];
-      double fwdrate = discyc_->fwdRate(t1, t2);
-      // risk free rate less yield plus convexity adjustment
-      drifts_(i, j) = (fwdrate - divylds_[j]) * (t2 - t1) - 0.5 * var;
+      if (t2 > t1) {
+        discyc_->fwdRateIntegralDerivs(t1, t2, derivs);
+        for (size_t k = 0; k < nrates; ++k)
+          driftRateDerivs_(i, k) = derivs[k];
+      }
       t1 = t2;
     }
+    discRateDerivs_.zeros(paytimes.size(), nrates);
+    for (size_t q = 0; q < paytimes.size(); ++q) {
+      discyc_->fwdRateIntegralDerivs(0.0, paytimes[q], derivs);
+      for (size_t k = 0; k < nrates; ++k)
+        discRateDerivs_(q, k) = -discfactors_[q] * derivs[k];
+    }
+  }
+
+  // Pass the initial spots and the log variances to the product, for monitoring between
+  // fixings; on a copy, so that the caller's product is left untouched
+  prod_ = prod->clone();
+  prod_->setBridgeData(spots_, stdevs_ % stdevs_);
+}
+
+void MultiAssetBsMcPricer::processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const
+{
+  pathgen.nextBlock(npaths, ws.paths);
+  if (mcparams_.momentMatching)
+    matchMoments(ws.paths);
+  double weight = mcparams_.antithetic ? 0.5 : 1.0;
+  if (!mcparams_.greeks) {
+    ws.pvs.zeros(npaths * nVariables());
+    if (mcparams_.singlePrecision || !prod.hasStreamingEval()) {
+      // the whole block at once, see Product::evalBlock
+      if (mcparams_.antithetic)
+        mirrorDeviates(ws.paths, ws.mirrorPaths);
+      addBlockPVs(prod, ws, ws.paths, weight);
+      if (mcparams_.antithetic)
+        addBlockPVs(prod, ws, ws.mirrorPaths, weight);
+      return;
+    }
+    // the mirror paths are the same deviates with the opposite sign
+    addStreamedPVs(prod, ws, ws.paths, weight, 1.0);
+    if (mcparams_.antithetic)
+      addStreamedPVs(prod, ws, ws.paths, weight, -1.0);
+    return;
+  }
+
+  if (mcparams_.antithetic)
+    mirrorDeviates(ws.paths, ws.mirrorPaths);
+
+  ws.pvs.zeros(npaths * nVariables());
+  ws.deviates = ws.paths;
+  toPrices(ws.paths);
+  addPVs(prod, ws, ws.paths, weight, 1.0);
+  if (mcparams_.antithetic) {
+    toPrices(ws.mirrorPaths);
+    addPVs(prod, ws, ws.mirrorPaths, weight, -1.0);
+  }
+}
+
+void MultiAssetBsMcPricer::toPrices(Matrix& paths) const
+{
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  for (size_t j = 0; j < nassets; ++j)
+    toGbmPrices(paths.colptr(j * ntimesteps), paths.n_rows, ntimesteps, spots_[j],
+                drifts_.colptr(j), stdevs_.colptr(j));
+}
+
+void MultiAssetBsMcPricer::addBlockPVs(Product& prod, McWorkspace& ws, Matrix& paths, double weight) const
+{
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  size_t npaths = paths.n_rows;
+  size_t nvars = nVariables();
+  if (mcparams_.singlePrecision) {
+    for (size_t j = 0; j < nassets; ++j)
+      toPricesSinglePrecision(paths.colptr(j * ntimesteps), npaths, ntimesteps, spots_[j],
+                              drifts_.colptr(j), stdevs_.colptr(j), ws.floatPaths);
   }
+  else
+    toPrices(paths);
+  prod.evalBlock(paths, discfactors_, ws.blockPvs);
+  for (size_t p = 0; p < npaths; ++p)
+    ws.pvs[p * nvars] += weight * ws.blockPvs[p];
+}
 
-  // Resize the payment amounts
-  payamts_.resize(prod->payTimes().size());
+void MultiAssetBsMcPricer::addStreamedPVs(Product& prod, McWorkspace& ws, Matrix const& deviates,
+                                          double weight, double dsign) const
+{
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  size_t nvars = nVariables();
+  ws.slice.set_size(nassets);
+  ws.logSlice.set_size(nassets);
+  for (size_t p = 0; p < deviates.n_rows; ++p) {
+    for (size_t j = 0; j < nassets; ++j)
+      ws.logSlice[j] = log(spots_[j]);
+    prod.startPath();
+    for (size_t i = 0; i < ntimesteps; ++i) {
+      for (size_t j = 0; j < nassets; ++j) {
+        ws.logSlice[j] = ws.logSlice[j] + drifts_(i, j) + stdevs_(i, j) * (dsign * deviates(p, j * ntimesteps + i));
+        ws.slice[j] = ws.logSlice[j];
+      }
+      expInPlace(ws.slice.memptr(), nassets);
+      if (!prod.observeFixing(i, ws.slice))
+        break;
+    }
+    prod.finishPath();
+    Vector const& payamts = prod.payAmounts();
 
+    double pv = 0.0;
+    for (size_t i = 0; i < payamts.size(); ++i)
+      pv += discfactors_[i] * payamts[i];
+    ws.pvs[p * nvars] += weight * pv;
+  }
 }
 
-double MultiAssetBsMcPricer::processOnePath(Matrix& pricePath)
+void MultiAssetBsMcPricer::addPVs(Product& prod, McWorkspace& ws, Matrix const& paths, double weight,
+                                  double wsign) const
 {
-  pathgen_->next(pricePath);
-  size_t nassets = prod_->nAssets();
-  currspots_ = spots_;               // initialize the current spots array
-  // convert the normal deviates to a price path in-place
-  for (size_t i = 0; i < pricePath.n_rows; ++i) {
-    for (size_t j = 0; j < nassets; ++j) {
-      double normaldeviate = pricePath(i, j);
-      pricePath(i, j) = currspots_[j] * exp(drifts_(i, j) + stdevs_(i, j) * normaldeviate);
-      currspots_[j] = pricePath(i, j);  // store the spot for the next time step
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  size_t nvars = nVariables();
+  ws.pricePath.set_size(ntimesteps, nassets);
+  for (size_t p = 0; p < paths.n_rows; ++p) {
+    for (size_t j = 0; j < nassets; ++j)
+      for (size_t i = 0; i < ntimesteps; ++i)
+        ws.pricePath(i, j) = paths(p, j * ntimesteps + i);
+    if (mcparams_.greeks) {
+      bool pathwise = prod.evalPathwise(ws.pricePath, ws.payDerivs);
+      ORF_ASSERT(pathwise, "MultiAssetBsMcPricer: the Greeks need a product with pathwise derivatives!");
+    }
+    else
+      prod.eval(ws.pricePath);
+    Vector const& payamts = prod.payAmounts();
+
+    double pv = 0.0;
+    for (size_t i = 0; i < payamts.size(); ++i)
+      pv += discfactors_[i] * payamts[i];
+    double* out = &ws.pvs[p * nvars];
+    out[0] += weight * pv;
+
+    if (mcparams_.greeks) {
+      ws.greeks.set_size(nvars - 1);
+      adjointGreeks(ws, p, wsign, payamts, ws.greeks.memptr());
+      for (size_t g = 0; g < nvars - 1; ++g)
+        out[1 + g] += weight * ws.greeks[g];
     }
   }
-  prod_->eval(pricePath);
-  payamts_ = prod_->payAmounts();
+}
 
-  double pv = 0.0;
-  for (size_t i = 0; i < payamts_.size(); ++i)
-    pv += discfactors_[i] * payamts_[i];
+void MultiAssetBsMcPricer::adjointGreeks(McWorkspace& ws, size_t p, double wsign, Vector const& payamts,
+                                         double* greeks) const
+{
+  // The path was computed forwards as
+  //   x(i, j) = x(i - 1, j) + drift(i, j) + stdev(i, j) * z(i, j),  x(-1, j) = log S0(j),  S(i, j) = exp(x(i, j))
+  //   drift(i, j) = int f(t) dt - q(j) * dt(i) - vol(i, j)^2 * dt(i) / 2,  stdev(i, j) = vol(i, j) * sqrt(dt(i))
+  // with vol(i, j) the forward vol of asset j over time step i; the vega of asset j shifts all of them,
+  // and stdev(i, j) by dstdev(i, j), see GbmSteps::volDerivs
+  //   pv = sum_q df(q) * pay(q),  df(q) = exp(-int f(t) dt)
+  // The sweep below goes backwards from pv: xbar, the adjoint of x(i, j), accumulates along the path
+  // and is also the adjoint of drift(i, j), and at the start that of log S0(j)
+  size_t nassets = drifts_.n_cols;
+  size_t ntimesteps = drifts_.n_rows;
+  size_t nrates = driftRateDerivs_.n_cols;
+  size_t npays = payamts.n_elem;
+  double* deltas = greeks;
+  double* vegas = greeks + nassets;
+  double* rhos = greeks + 2 * nassets;
+  Matrix const& payDerivs = ws.payDerivs;
+  ws.adjoints.zeros(ntimesteps);        // the adjoint of the integrated forward rate of each time step
 
-  return pv;
+  for (size_t j = 0; j < nassets; ++j) {
+    double xbar = 0.0, volbar = 0.0;
+    for (size_t i = ntimesteps; i-- > 0;) {
+      size_t k = j * ntimesteps + i;
+      double sbar = 0.0;
+      for (size_t q = 0; q < npays; ++q)
+        sbar += discfactors_[q] * payDerivs(q, k);
+      xbar += sbar * ws.pricePath[k];
+      double z = wsign * ws.deviates(p, k);
+      volbar += xbar * volDerivs_(i, j) * (z - stdevs_(i, j));
+      ws.adjoints[i] += xbar;
+    }
+    deltas[j] = xbar / spots_[j];
+    vegas[j] = volbar;
+  }
+  // through the drifts and the discount factors to the forward rates of the curve
+  for (size_t k = 0; k < nrates; ++k) {
+    double rbar = 0.0;
+    for (size_t i = 0; i < ntimesteps; ++i)
+      rbar += ws.adjoints[i] * driftRateDerivs_(i, k);
+    for (size_t q = 0; q < npays; ++q)
+      rbar += payamts[q] * discRateDerivs_(q, k);
+    rhos[k] = rbar;
+  }
 }
 
 END_NAMESPACE(orf)
@@ -9,14 +9,21 @@
 
 #include <orflib/products/product.hpp>
 #include <orflib/market/yieldcurve.hpp>
+#include <orflib/market/volatilitytermstructure.hpp>
 #include <orflib/methods/montecarlo/mcparams.hpp>
 #include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/methods/montecarlo/parallelsimulation.hpp>
 #include <orflib/math/stats/statisticscalculator.hpp>
 
+#include <vector>
+
 BEGIN_NAMESPACE(orf)
 
 /** Multiasset Monte Carlo pricer in the Black-Scholes model (deterministic rates and vols).
     Current constraint: all assets must be in the same economy, i.e. share the same yield curve.
+    The log spots step exactly from fixing to fixing with the forward vols, see GbmSteps.
+    Supports antithetic sampling, moment matching, Greeks and single precision;
+    McParams::controlVariate is ignored.
     */
 class MultiAssetBsMcPricer
 {
@@ -26,30 +33,74 @@ public:
   MultiAssetBsMcPricer(SPtrProduct prod,
                        SPtrYieldCurve discountYieldCurve,
                        Vector const& divYields,
-                       Vector const& volatilities,
+                       std::vector<SPtrVolatilityTermStructure> const& volatilities,
                        Vector const& spots,
                        Matrix const& correlMatrix,
                        McParams const& mcparams);
 
-  /** Returns the number of variables that can be tracked for stats */
-  size_t nVariables();
-
-  /** Runs the simulation and collects statistics */
+  /** Returns the number of variables that can be tracked for stats: the price, followed
+      with McParams::greeks by the delta of each asset, the vega of each asset and the rho
+      to each forward rate of the discount curve, estimated in the same simulation, see adjointGreeks.
+      The vega of an asset is to a parallel shift of its forward vols.
+  */
+  size_t nVariables() const;
+
+  /** Runs the simulation and collects statistics.
+      The paths are distributed over McParams::nThreads threads;
+      the results do not depend on the number of threads.
+      With McParams::antithetic each sample is the average PV of a path and its mirror
+      image, so npaths samples take 2 * npaths price paths.
+      With McParams::nReplications > 1 each sample is the mean of one replication,
+      see simulateReplications. With a tolerance or a time budget in McParams, npaths is
+      the maximum number of paths, see simulateMc.
+      Returns the number of paths simulated and the elapsed time.
+  */
   template<typename ITER>
-  void simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths);
+  McRunInfo simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths);
 
 protected:
 
-  /** Creates and processes one price path.
-      It returns the PV of the product
+  /** Creates and processes the next npaths price paths with the passed-in generator and product.
+      The paths are generated as one block; the PVs are returned in ws.pvs
+  */
+  void processPaths(PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t npaths) const;
+
+  /** Converts a block of normal deviates to prices, in place */
+  void toPrices(Matrix& paths) const;
+
+  /** Adds weight times the PVs of a block of normal deviates, times dsign, to ws.pvs.
+      Each path is converted to prices one fixing at a time and passed to the product as it goes
+      (see Product::observeFixing), up to the last fixing the payments depend on, so that the
+      price paths are never stored. Used without Greeks, for products with Product::hasStreamingEval.
   */
-  double processOnePath(Matrix& pricePath);
+  void addStreamedPVs(Product& prod, McWorkspace& ws, Matrix const& deviates, double weight, double dsign) const;
+
+  /** Converts a block of normal deviates to prices, in place, in single precision with
+      McParams::singlePrecision (see toPricesSinglePrecision for the error bounds), and adds
+      weight times their PVs to ws.pvs, see Product::evalBlock.
+      Used without Greeks, for the other products or in single precision.
+  */
+  void addBlockPVs(Product& prod, McWorkspace& ws, Matrix& paths, double weight) const;
+
+  /** Adds weight times the PVs of a block of price paths to ws.pvs.
+      With McParams::greeks, also adds the Greeks, using the deviates in ws.deviates
+      times wsign (-1 for the mirror paths)
+  */
+  void addPVs(Product& prod, McWorkspace& ws, Matrix const& paths, double weight, double wsign) const;
+
+  /** Returns in greeks the adjoint Greeks of path p of the block, given its price path
+      and payment derivatives in ws, and its payment amounts. The payment derivatives from
+      Product::evalPathwise, which the product must have, are propagated backwards through the
+      discounting, the conversion of the deviates to prices and the drifts and standard deviations
+      computed from the curve: all the Greeks together cost about one extra pass over the path.
+  */
+  void adjointGreeks(McWorkspace& ws, size_t p, double wsign, Vector const& payamts, double* greeks) const;
 
 private:
   SPtrProduct prod_;               // pointer to the product
   SPtrYieldCurve discyc_;          // pointer to the discount curve
   Vector divylds_;                 // the constant dividend yield, one per asset   
-  Vector vols_;                    // the constant volatility, one per asset
+  std::vector<SPtrVolatilityTermStructure> vols_;  // the volatility term structure, one per asset
   Vector spots_;                   // the initial spots, one per asset
   McParams mcparams_;              // the Monte Carlo parameters
 
@@ -57,33 +108,32 @@ private:
   Vector discfactors_;         // caches the pre-computed discount factors
   Matrix drifts_;              // caches the pre-computed asset drifts, one column per asset
   Matrix stdevs_;              // caches the pre-computed standard deviations, one column per asset 
-
-  Vector currspots_;           // scratch array with the current spots, one per asset
-  Vector payamts_;             // scratch array for writting the payments after each simulation
+  Matrix volDerivs_;           // the derivatives of the stdevs w.r.t. the forward vols, see GbmSteps::volDerivs
+  Matrix driftRateDerivs_;     // the derivatives of the drift of each time step w.r.t. the forward rates
+  Matrix discRateDerivs_;      // the derivatives of the discount factors w.r.t. the forward rates
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Inline definitions
 
 inline
-size_t MultiAssetBsMcPricer::nVariables()
+size_t MultiAssetBsMcPricer::nVariables() const
 {
-  return 1;  // just one variable, the price
+  if (!mcparams_.greeks)
+    return 1;  // just one variable, the price
+  return 1 + 2 * spots_.n_elem + driftRateDerivs_.n_cols;
 }
 
 template<typename ITER>
-void MultiAssetBsMcPricer::simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths)
+McRunInfo MultiAssetBsMcPricer::simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths)
 {
-  // create the price path matrix
-  Matrix pricePath(pathgen_->nTimeSteps(), pathgen_->nFactors());
   // check the size of the statistics calculator
   ORF_ASSERT(statsCalc.nVariables() == nVariables(), "the statistics calculator must track as many variables as the pricer captures!");
 
-  // This is the HOT loop
-  for (unsigned long i = 0; i < npaths; ++i) {
-    double pv = processOnePath(pricePath);
-    statsCalc.addSample(&pv, &pv + 1);
-  }
+  return simulateMc(statsCalc, pathgen_, prod_, npaths, mcparams_,
+    [this](PathGenerator& pathgen, Product& prod, McWorkspace& ws, size_t n) {
+      processPaths(pathgen, prod, ws, n);
+    });
 }
 
 END_NAMESPACE(orf)
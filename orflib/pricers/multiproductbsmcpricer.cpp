@@ -0,0 +1,121 @@
+/**
+@file  multiproductbsmcpricer.cpp
+@brief Implementation of the MultiProductBsMcPricer class
+*/
+
+#include <orflib/pricers/multiproductbsmcpricer.hpp>
+#include <orflib/methods/montecarlo/pathgeneratorfactory.hpp>
+#include <orflib/methods/montecarlo/gbmsteps.hpp>
+#include <orflib/methods/montecarlo/momentmatching.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+BEGIN_NAMESPACE(orf)
+
+MultiProductBsMcPricer::MultiProductBsMcPricer(std::vector<SPtrProduct> const& prods,
+                                               SPtrYieldCurve discountCurve,
+                                               double divYield,
+                                               SPtrVolatilityTermStructure volatility,
+                                               double spot,
+                                               McParams mcparams)
+: discyc_(discountCurve), divyld_(divYield), vol_(volatility), spot_(spot), mcparams_(mcparams)
+{
+  ORF_ASSERT(!prods.empty(), "MultiProductBsMcPricer: no products!");
+
+  // The simulation times are the union of the fixing times of all products
+  vector<double> times;
+  for (auto const& prod : prods) {
+    ORF_ASSERT(prod->nAssets() == 1, "MultiProductBsMcPricer: the products must be on a single asset!");
+    Vector const& fixtimes = prod->fixTimes();
+    times.insert(times.end(), fixtimes.begin(), fixtimes.end());
+  }
+  sort(times.begin(), times.end());
+  times.erase(unique(times.begin(), times.end()), times.end());
+
+  // Create the path generator, one factor to simulate the spot
+  pathgen_ = makePathGenerator(mcparams, Vector(times), 1);
+
+  // Pre-compute the stdevs and drifts from time step to time step
+  GbmSteps steps(Vector(times), discyc_, divyld_, vol_);
+  drifts_ = steps.drifts();
+  stdevs_ = steps.stdevs();
+
+  // Locate the fixings of each product on the time line, pre-compute its discount factors
+  // and pass it the initial spot and the log variances between its fixings, the sums of
+  // those of the time steps in between; on a copy so that the caller's product is left untouched
+  Vector spots(1);
+  spots[0] = spot_;
+  for (auto const& prod : prods) {
+    Vector const& fixtimes = prod->fixTimes();
+    vector<size_t> idx(fixtimes.n_elem);
+    Matrix logvars(fixtimes.n_elem, 1);
+    for (size_t k = 0; k < fixtimes.n_elem; ++k) {
+      idx[k] = lower_bound(times.begin(), times.end(), fixtimes[k]) - times.begin();
+      logvars(k, 0) = 0.0;
+      for (size_t i = k > 0 ? idx[k - 1] + 1 : 0; i <= idx[k]; ++i)
+        logvars(k, 0) += stdevs_[i] * stdevs_[i];
+    }
+    fixIdx_.push_back(idx);
+
+    Vector const& paytimes = prod->payTimes();
+    Vector discfactors(paytimes.size());
+    for (size_t i = 0; i < paytimes.size(); ++i)
+      discfactors[i] = discyc_->discount(paytimes[i]);
+    discfactors_.push_back(discfactors);
+
+    SPtrProduct myprod = prod->clone();
+    myprod->setBridgeData(spots, logvars);
+    prods_.push_back(myprod);
+  }
+}
+
+void MultiProductBsMcPricer::processPaths(PathGenerator& pathgen, McWorkspace& ws, size_t npaths) const
+{
+  pathgen.nextBlock(npaths, ws.paths);
+  if (mcparams_.momentMatching)
+    matchMoments(ws.paths);
+  if (mcparams_.antithetic)
+    mirrorDeviates(ws.paths, ws.mirrorPaths);
+
+  ws.pvs.zeros(npaths * nVariables());
+  // this thread's copies of the products
+  if (ws.products.empty()) {
+    for (auto const& prod : prods_)
+      ws.products.push_back(prod->clone());
+  }
+  double weight = mcparams_.antithetic ? 0.5 : 1.0;
+  toPrices(ws.paths);
+  addPVs(ws, ws.paths, weight);
+  if (mcparams_.antithetic) {
+    toPrices(ws.mirrorPaths);
+    addPVs(ws, ws.mirrorPaths, weight);
+  }
+}
+
+void MultiProductBsMcPricer::toPrices(Matrix& paths) const
+{
+  toGbmPrices(paths.memptr(), paths.n_rows, paths.n_cols, spot_, drifts_.memptr(), stdevs_.memptr());
+}
+
+void MultiProductBsMcPricer::addPVs(McWorkspace& ws, Matrix const& paths, double weight) const
+{
+  size_t nprods = prods_.size();
+  for (size_t k = 0; k < nprods; ++k) {
+    Product& prod = *ws.products[k];
+    vector<size_t> const& idx = fixIdx_[k];
+    Vector const& discfactors = discfactors_[k];
+    // the product's view of the block: its fixings, gathered from the time line
+    size_t npaths = paths.n_rows;
+    ws.pricePath.set_size(npaths, idx.size());
+    for (size_t i = 0; i < idx.size(); ++i)
+      std::copy(paths.colptr(idx[i]), paths.colptr(idx[i]) + npaths, ws.pricePath.colptr(i));
+    prod.evalBlock(ws.pricePath, discfactors, ws.blockPvs);
+    for (size_t p = 0; p < npaths; ++p)
+      ws.pvs[p * nprods + k] += weight * ws.blockPvs[p];
+  }
+}
+
+END_NAMESPACE(orf)
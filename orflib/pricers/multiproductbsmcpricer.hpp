@@ -0,0 +1,118 @@
+/**
+@file  multiproductbsmcpricer.hpp
+@brief Monte Carlo pricer of several products on the same paths in the Black Scholes model
+*/
+
+#ifndef ORF_MULTIPRODUCTBSMCPRICER_HPP
+#define ORF_MULTIPRODUCTBSMCPRICER_HPP
+
+#include <orflib/products/product.hpp>
+#include <orflib/market/yieldcurve.hpp>
+#include <orflib/market/volatilitytermstructure.hpp>
+#include <orflib/methods/montecarlo/mcparams.hpp>
+#include <orflib/methods/montecarlo/pathgenerator.hpp>
+#include <orflib/methods/montecarlo/parallelsimulation.hpp>
+#include <orflib/math/stats/statisticscalculator.hpp>
+
+#include <vector>
+
+BEGIN_NAMESPACE(orf)
+
+/** Monte Carlo pricer of a book of single asset products on the same underlying in the
+    Black-Scholes model (deterministic rates and vols).
+    The paths are simulated once, on the union of the fixing times of all products,
+    and every product is evaluated on every path, so the book costs one simulation and
+    the prices share common random numbers: their differences have a small variance.
+    The steps of the log spot over the union of the fixing times are computed once,
+    exactly from the forward vols of the volatility term structure (see GbmSteps),
+    and give the log variances between the fixings of every product.
+    The PV of product k is variable k of the statistics calculator.
+    Supports antithetic sampling, moment matching and stratification, see McParams;
+    control variates and Greeks are ignored.
+*/
+class MultiProductBsMcPricer
+{
+public:
+  /** Initializing ctor */
+  MultiProductBsMcPricer(std::vector<SPtrProduct> const& prods,
+                         SPtrYieldCurve discountYieldCurve,
+                         double divYield,
+                         SPtrVolatilityTermStructure volatility,
+                         double spot,
+                         McParams mcparams);
+
+  /** Returns the number of variables that can be tracked for stats: the PV of each product */
+  size_t nVariables() const;
+
+  /** Returns the number of time steps of the simulation, the union of the fixing times */
+  size_t nTimeSteps() const;
+
+  /** Runs the simulation and collects statistics, see BsMcPricer::simulate.
+      With a tolerance in McParams, it applies to the first product.
+      Returns the number of paths simulated and the elapsed time.
+  */
+  template<typename ITER>
+  McRunInfo simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths);
+
+protected:
+
+  /** Creates and processes the next npaths price paths with the passed-in generator.
+      Each thread evaluates its own copies of the products, kept in ws.products;
+      the PVs are returned in ws.pvs
+  */
+  void processPaths(PathGenerator& pathgen, McWorkspace& ws, size_t npaths) const;
+
+  /** Converts a block of normal deviates to prices, in place */
+  void toPrices(Matrix& paths) const;
+
+  /** Adds weight times the PVs of all products on a block of price paths to ws.pvs;
+      each product evaluates the block at once, see Product::evalBlock
+  */
+  void addPVs(McWorkspace& ws, Matrix const& paths, double weight) const;
+
+private:
+  std::vector<SPtrProduct> prods_;  // the products, with their bridge data
+  SPtrYieldCurve discyc_;           // pointer to the discount curve
+  double divyld_;                   // the constant dividend yield
+  SPtrVolatilityTermStructure vol_; // the volatility term structure
+  double spot_;                     // the initial spot
+  McParams mcparams_;               // the Monte Carlo parameters
+
+  SPtrPathGenerator pathgen_;       // pointer to the path generator
+  Vector drifts_;                   // caches the pre-computed asset drifts
+  Vector stdevs_;                   // caches the pre-computed standard deviations
+  std::vector<std::vector<size_t>> fixIdx_;  // the time step of each fixing of each product
+  std::vector<Vector> discfactors_;          // the discount factors of the payments of each product
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+
+inline
+size_t MultiProductBsMcPricer::nVariables() const
+{
+  return prods_.size();
+}
+
+inline
+size_t MultiProductBsMcPricer::nTimeSteps() const
+{
+  return drifts_.n_elem;
+}
+
+template<typename ITER>
+McRunInfo MultiProductBsMcPricer::simulate(StatisticsCalculator<ITER>& statsCalc, unsigned long npaths)
+{
+  ORF_ASSERT(statsCalc.nVariables() == nVariables(), "the statistics calculator must track as many variables as the pricer captures!");
+
+  // the simulation loop clones the first product for each thread; the products
+  // are evaluated on the thread's own copies in the workspace
+  return simulateMc(statsCalc, pathgen_, prods_[0], npaths, mcparams_,
+    [this](PathGenerator& pathgen, Product&, McWorkspace& ws, size_t n) {
+      processPaths(pathgen, ws, n);
+    });
+}
+
+END_NAMESPACE(orf)
+
+#endif // ORF_MULTIPRODUCTBSMCPRICER_HPP
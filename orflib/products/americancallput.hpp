@@ -10,17 +10,39 @@
 
 BEGIN_NAMESPACE(orf)
 
-/** The American call/put class
+/** The American call/put class.
+    On whole paths, without continuation values, it is exercised at expiration only: the
+    evaluations below read the last fixing, pay at the last payment time and pay zero at the
+    others, a lower bound of the price. For the early exercise premium, see LsmBsMcPricer.
 */
-class AmericanCallPut : public EuropeanCallPut
+class AmericanCallPut : public BatchedProduct<AmericanCallPut, EuropeanCallPut>
 {
 public:
   /** Initializing ctor */
   AmericanCallPut(int payoffType, double strike, double timeToExp);
 
+  /** Returns a copy of this product */
+  virtual SPtrProduct clone() const override;
+
+  /** Evaluates the product given the passed-in path, exercising at expiration */
+  virtual void eval(Matrix const& pricePath) override;
+
+  /** Evaluates the product and the derivative of the payment at expiration with respect to the spot */
+  virtual bool evalPathwise(Matrix const& pricePath, Matrix& payDerivs) override;
+
+  /** Streaming evaluation: the payment only depends on the last fixing */
+  virtual bool observeFixing(size_t idx, Vector const& spots) override;
+  virtual void finishPath() override;
+
+  /** Evaluates the product on a block of paths; only the last fixing and payment are read */
+  virtual void evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs) override;
+
   /** Evaluates the product at fixing time index idx
   */
   virtual void eval(size_t idx, Vector const& pricePath, double contValue);
+
+  /** Returns the intrinsic value at fixing time index idx; the payment amounts are left as they are */
+  virtual double exerciseValue(size_t idx, Vector const& spots) override;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -28,7 +50,7 @@ public:
 
 inline
 AmericanCallPut::AmericanCallPut(int payoffType, double strike, double timeToExp)
-: EuropeanCallPut(payoffType, strike, timeToExp)
+: BatchedProduct<AmericanCallPut, EuropeanCallPut>(payoffType, strike, timeToExp)
 {
   // count the number of days between 0 and timeToExp
   size_t nfixings = static_cast<size_t>(timeToExp * DAYS_PER_YEAR) + 1;
@@ -44,6 +66,60 @@ AmericanCallPut::AmericanCallPut(int payoffType, double strike, double timeToExp
   payAmounts_.resize(payTimes_.size());
 }
 
+inline SPtrProduct AmericanCallPut::clone() const
+{
+  return SPtrProduct(new AmericanCallPut(*this));
+}
+
+inline void AmericanCallPut::eval(Matrix const& pricePath)
+{
+  size_t last = payAmounts_.size() - 1;
+  for (size_t j = 0; j < last; ++j)
+    payAmounts_[j] = 0.0;
+  double payoff = (pricePath(last, 0) - strike_) * payoffType_;
+  payAmounts_[last] = payoff > 0.0 ? payoff : 0.0;
+}
+
+inline bool AmericanCallPut::evalPathwise(Matrix const& pricePath, Matrix& payDerivs)
+{
+  eval(pricePath);
+  size_t last = payAmounts_.size() - 1;
+  payDerivs.zeros(payAmounts_.size(), pricePath.n_elem);
+  if ((pricePath(last, 0) - strike_) * payoffType_ > 0.0)
+    payDerivs(last, last) = payoffType_;
+  return true;
+}
+
+inline bool AmericanCallPut::observeFixing(size_t idx, Vector const& spots)
+{
+  if (idx + 1 < fixTimes_.size())
+    return true;
+  streamSpot_ = spots[0];
+  return false;
+}
+
+inline void AmericanCallPut::finishPath()
+{
+  size_t last = payAmounts_.size() - 1;
+  for (size_t j = 0; j < last; ++j)
+    payAmounts_[j] = 0.0;
+  double payoff = (streamSpot_ - strike_) * payoffType_;
+  payAmounts_[last] = payoff > 0.0 ? payoff : 0.0;
+}
+
+inline void AmericanCallPut::evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs)
+{
+  size_t npaths = paths.n_rows;
+  size_t last = fixTimes_.size() - 1;
+  pvs.set_size(npaths);
+  double const* S_T = paths.colptr(last);
+  double df = discfactors[last];
+  for (size_t p = 0; p < npaths; ++p) {
+    double payoff = (S_T[p] - strike_) * payoffType_;
+    pvs[p] = payoff > 0.0 ? df * payoff : 0.0;
+  }
+}
+
 // This product has as many fixings as days between 0 and time to expiration.
 inline void AmericanCallPut::eval(size_t idx, Vector const& spots, double contValue)
 {
@@ -63,6 +139,12 @@ inline void AmericanCallPut::eval(size_t idx, Vector const& spots, double contVa
   }
 }
 
+inline double AmericanCallPut::exerciseValue(size_t, Vector const& spots)
+{
+  double payoff = (spots[0] - strike_) * payoffType_;
+  return payoff > 0.0 ? payoff : 0.0;
+}
+
 END_NAMESPACE(orf)
 
 #endif // ORF_AMERICANCALLPUT_HPP
@@ -14,7 +14,7 @@ BEGIN_NAMESPACE(orf)
 
 /** The Asian basket call/put class
 */
-class AsianBasketCallPut : public Product
+class AsianBasketCallPut : public BatchedProduct<AsianBasketCallPut>
 {
 public:
   /** Initializing ctor */
@@ -26,12 +26,27 @@ public:
   /** The number of assets this product depends on */
   virtual size_t nAssets() const override;
 
+  /** Returns a copy of this product */
+  virtual SPtrProduct clone() const override;
+
   /** Evaluates the product given the passed-in path
       The "pricePath" matrix must have as many rows as
       the number of fixing times
       */
   virtual void eval(Matrix const& pricePath) override;
 
+  /** Evaluates the product and the derivatives of the payment with respect to the path */
+  virtual bool evalPathwise(Matrix const& pricePath, Matrix& payDerivs) override;
+
+  /** Streaming evaluation, with the running sum of the basket values */
+  virtual void startPath() override;
+  virtual bool observeFixing(size_t idx, Vector const& spots) override;
+  virtual void finishPath() override;
+  virtual bool hasStreamingEval() const override;
+
+  /** Evaluates the product on a block of paths, one fixing at a time across the paths */
+  virtual void evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs) override;
+
   /** Evaluates the product at fixing time index idx
   */
   virtual void eval(size_t idx, Vector const& spots, double contValue) override;
@@ -40,6 +55,7 @@ private:
   int payoffType_;          // 1: call; -1 put
   double strike_;
   Vector assetQuantities_;  // number of units of each asset in the basket
+  double streamSum_;        // the sum of the basket values so far, for the streaming evaluation
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -50,7 +66,7 @@ AsianBasketCallPut::AsianBasketCallPut(int payoffType,
                                        double strike,
                                        Vector const& fixingTimes,
                                        Vector const& assetQuantities)
-: payoffType_(payoffType), strike_(strike), assetQuantities_(assetQuantities)
+: payoffType_(payoffType), strike_(strike), assetQuantities_(assetQuantities), streamSum_(0.0)
 {
   ORF_ASSERT(payoffType == 1 || payoffType == -1, "AsianBasketCallPut: the payoff type must be 1 (call) or -1 (put)!");
   ORF_ASSERT(strike >= 0.0, "AsianBasketCallPut: the strike must be positive!");
@@ -78,6 +94,11 @@ size_t AsianBasketCallPut::nAssets() const
   return assetQuantities_.size();
 }
 
+inline SPtrProduct AsianBasketCallPut::clone() const
+{
+  return SPtrProduct(new AsianBasketCallPut(*this));
+}
+
 inline void AsianBasketCallPut::eval(Matrix const& pricePath)
 {
   double bsktAvg = 0;
@@ -103,6 +124,75 @@ inline void AsianBasketCallPut::eval(Matrix const& pricePath)
     payAmounts_[0] = bsktAvg >= strike_ ? 0.0 : strike_ - bsktAvg;
 }
 
+inline bool AsianBasketCallPut::evalPathwise(Matrix const& pricePath, Matrix& payDerivs)
+{
+  eval(pricePath);
+  size_t nfixings = pricePath.n_rows;
+  size_t nassets = pricePath.n_cols;
+  payDerivs.zeros(1, pricePath.n_elem);
+  if (payAmounts_[0] > 0.0) {   // in the money: linear in the basket average
+    for (size_t j = 0; j < nassets; ++j)
+      for (size_t i = 0; i < nfixings; ++i)
+        payDerivs(0, j * nfixings + i) = payoffType_ * assetQuantities_[j] / nfixings;
+  }
+  return true;
+}
+
+inline void AsianBasketCallPut::startPath()
+{
+  streamSum_ = 0.0;
+}
+
+inline bool AsianBasketCallPut::observeFixing(size_t, Vector const& spots)
+{
+  double bsktval = 0.0;
+  for (size_t j = 0; j < assetQuantities_.size(); ++j) {
+    bsktval += assetQuantities_[j] * spots[j];
+  }
+  streamSum_ += bsktval;
+  return true;
+}
+
+inline void AsianBasketCallPut::finishPath()
+{
+  double bsktAvg = streamSum_ / fixTimes_.size();
+  if (payoffType_ == 1)
+    payAmounts_[0] = bsktAvg >= strike_ ? bsktAvg - strike_ : 0.0;
+  else
+    payAmounts_[0] = bsktAvg >= strike_ ? 0.0 : strike_ - bsktAvg;
+}
+
+inline bool AsianBasketCallPut::hasStreamingEval() const
+{
+  return true;
+}
+
+inline void AsianBasketCallPut::evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs)
+{
+  size_t npaths = paths.n_rows;
+  size_t nfixings = fixTimes_.size();
+  size_t nassets = assetQuantities_.size();
+  ORF_ASSERT(paths.n_cols == nfixings * nassets,
+    "AsianBasketCallPut: number of fixings or assets mismatch in the paths!");
+
+  // the basket sum of each path, in pvs
+  pvs.zeros(npaths);
+  for (size_t i = 0; i < nfixings; ++i) {
+    for (size_t p = 0; p < npaths; ++p) {
+      double bsktval = 0.0;
+      for (size_t j = 0; j < nassets; ++j)
+        bsktval += assetQuantities_[j] * paths(p, j * nfixings + i);
+      pvs[p] += bsktval;
+    }
+  }
+  double df = discfactors[0];
+  for (size_t p = 0; p < npaths; ++p) {
+    double bsktAvg = pvs[p] / nfixings;
+    double payoff = (bsktAvg - strike_) * payoffType_;
+    pvs[p] = payoff > 0.0 ? df * payoff : 0.0;
+  }
+}
+
 // Not implemented
 inline void AsianBasketCallPut::eval(size_t idx, Vector const& spots, double contValue)
 {
@@ -8,30 +8,102 @@
 
 #include <orflib/products/europeancallput.hpp>
 
+#include <cmath>
+#include <limits>
+
 BEGIN_NAMESPACE(orf)
 
 /** The Barrier call/put class
 */
-class BarrierCallPut : public EuropeanCallPut
+class BarrierCallPut : public BatchedProduct<BarrierCallPut, EuropeanCallPut>
 {
 public:
 	enum class Freq
 	{
 		MONTHLY,      // 12/year
 		WEEKLY,       // 52/year
-		DAILY         // 365/year
+		DAILY,        // 365/year
+		CONTINUOUS    // monitoring only
 	};
-	/** Initializing ctor */
+	/** Initializing ctor, the barrier is monitored at the fixing times */
 	BarrierCallPut(int payoffType, double strike, double timeToExp, int up_or_down, double barrier, Freq freq);
 
+	/** Initializing ctor with the fixings at frequency freq and the barrier monitored
+	    at frequency monitoringFreq, which must be at least as high.
+	    In Monte Carlo the barrier is monitored between fixings with the Brownian bridge:
+	    exactly if monitoring is continuous, and with the Broadie-Glasserman-Kou
+	    shifted barrier otherwise. The PDE evaluation monitors at the fixing times only.
+	*/
+	BarrierCallPut(int payoffType, double strike, double timeToExp, int up_or_down, double barrier, Freq freq,
+		Freq monitoringFreq);
+
+	/** Returns the barrier level */
+	double barrier() const { return barrier_; }
+
+	/** Returns 1 for an up barrier, 0 for a down barrier */
+	int upOrDown() const { return up_or_down_; }
+
+	/** Returns the fixing frequency */
+	Freq fixingFreq() const { return freq_; }
+
+	/** Returns the monitoring frequency */
+	Freq monitoringFreq() const { return monitoringFreq_; }
+
+	/** Returns a copy of this product */
+	virtual SPtrProduct clone() const override;
+
+	/** Returns the European option with the same payoff as control variate */
+	virtual SPtrProduct controlVariate() const override;
+
+	/** The streaming evaluation keeps the survival probability and the last spot only */
+	virtual bool hasStreamingEval() const override;
+
+	/** Evaluates the product given the passed-in path.
+	    Paths knocked out at a fixing pay nothing, the others pay the option payoff
+	    times their probability of surviving between fixings.
+	*/
+	virtual void eval(Matrix const& pricePath) override;
+
+	/** Evaluates the product; the payoff is discontinuous at the barrier, so returns false */
+	virtual bool evalPathwise(Matrix const& pricePath, Matrix& payDerivs) override;
+
+	/** Streaming evaluation, with the survival probability and the last spot;
+	    a knocked out path needs no further fixings
+	*/
+	virtual void startPath() override;
+	virtual bool observeFixing(size_t idx, Vector const& spots) override;
+	virtual void finishPath() override;
+
+	/** Evaluates the product on a block of paths; only the last payment can be nonzero */
+	virtual void evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs) override;
+
 	/** Evaluates the product at fixing time index idx
 	*/
 	virtual void eval(size_t idx, Vector const& pricePath, double contValue);
 
+	/** Stores the initial spot and the log variances between fixings for the bridge */
+	virtual void setBridgeData(Vector const& spots, Matrix const& logVariances) override;
+
+	/** Returns the barrier at each fixing, as seen by the Monte Carlo evaluation */
+	virtual bool knockOutBarriers(Vector& lower, Vector& upper) const override;
+
+	/** The number of fixings (or monitoring dates) per year, 0 for continuous */
+	static double freqPerYear(Freq freq);
+
 private:
+	// The payment at expiration on the path with fixings spots[0], spots[stride], ...
+	double pathPayoff(double const* spots, size_t stride) const;
+
 	double barrier_;
 	Freq freq_;
 	int up_or_down_;         // 1: up; 0 down
+	Freq monitoringFreq_;
+	double bridgeSpot_;      // the initial spot
+	Vector bridgeVars_;      // the log variance from the previous fixing to each fixing
+	Vector bridgeBarriers_;  // the continuous barrier equivalent to the monitored one, per fixing
+	double streamSurvival_;  // the state of the streaming evaluation: the survival probability,
+	double streamPrevSpot_;  // the spot at the last fixing
+	bool streamKnockedOut_;  // and whether the path is knocked out
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -39,28 +111,26 @@ private:
 
 inline
 BarrierCallPut::BarrierCallPut(int payoffType, double strike, double timeToExp, int up_or_down, double barrier, Freq freq)
-	: EuropeanCallPut(payoffType, strike, timeToExp), up_or_down_(up_or_down), barrier_(barrier), freq_(freq)
+	: BarrierCallPut(payoffType, strike, timeToExp, up_or_down, barrier, freq, freq)
+{}
+
+inline
+BarrierCallPut::BarrierCallPut(int payoffType, double strike, double timeToExp, int up_or_down, double barrier, Freq freq,
+	Freq monitoringFreq)
+	: BatchedProduct<BarrierCallPut, EuropeanCallPut>(payoffType, strike, timeToExp), up_or_down_(up_or_down), barrier_(barrier), freq_(freq),
+	monitoringFreq_(monitoringFreq), bridgeSpot_(0.0), streamSurvival_(1.0), streamPrevSpot_(0.0),
+	streamKnockedOut_(false)
 {
 	ORF_ASSERT(payoffType == 1 || payoffType == -1, "BarrierCallPut: the payoff type must be 1 (call) or -1 (put)!");
 	ORF_ASSERT(up_or_down == 1 || up_or_down == 0, "BarrierCallPut: the up_or_down type must be 1 (up) or 0 (down)!");
 	ORF_ASSERT(strike > 0.0, "BarrierCallPut: the strike must be positive!");
 	ORF_ASSERT(timeToExp > 0.0, "BarrierCallPut: the time to expiration must be positive!");
 	
-	// switch for the number of days between 0 and timeToExp
-	double num_freq;
-	switch (freq) {
-	case BarrierCallPut::Freq::MONTHLY:
-		num_freq = 12;  //12
-		break;
-	case BarrierCallPut::Freq::WEEKLY:
-		num_freq = 52;  // 52
-		break;
-	case BarrierCallPut::Freq::DAILY:
-		num_freq = 365;  //365
-		break;
-	default:
-		ORF_ASSERT(0, "BarrierCallPut: unknown frequency input type");
-	}
+	// the number of fixings between 0 and timeToExp
+	ORF_ASSERT(freq != Freq::CONTINUOUS, "BarrierCallPut: the fixing frequency cannot be continuous");
+	double num_freq = freqPerYear(freq);
+	ORF_ASSERT(monitoringFreq == Freq::CONTINUOUS || freqPerYear(monitoringFreq) >= num_freq,
+		"BarrierCallPut: the monitoring frequency must be at least the fixing frequency");
 
 	//size_t nfixings = static_cast<size_t>(timeToExp * num_freq);
 	//Alternative experimental code
@@ -105,7 +175,167 @@ BarrierCallPut::BarrierCallPut(int payoffType, double strike, double timeToExp,
 
 }
 
+inline SPtrProduct BarrierCallPut::clone() const
+{
+	return SPtrProduct(new BarrierCallPut(*this));
+}
+
+inline double BarrierCallPut::freqPerYear(Freq freq)
+{
+	switch (freq) {
+	case BarrierCallPut::Freq::MONTHLY:
+		return 12;
+	case BarrierCallPut::Freq::WEEKLY:
+		return 52;
+	case BarrierCallPut::Freq::DAILY:
+		return 365;
+	case BarrierCallPut::Freq::CONTINUOUS:
+		return 0;
+	default:
+		ORF_ASSERT(0, "BarrierCallPut: unknown frequency input type");
+	}
+	return 0;
+}
+
+inline SPtrProduct BarrierCallPut::controlVariate() const
+{
+	return SPtrProduct(new EuropeanCallPut(payoffType_, strike_, timeToExp_));
+}
+
+inline void BarrierCallPut::setBridgeData(Vector const& spots, Matrix const& logVariances)
+{
+	if (monitoringFreq_ == freq_)
+		return;   // monitored at the fixings only, no bridge needed
+	size_t nfix = fixTimes_.size();
+	ORF_ASSERT(logVariances.n_rows == nfix, "BarrierCallPut: need one log variance per fixing!");
+	bridgeSpot_ = spots[0];
+	bridgeVars_.resize(nfix);
+	bridgeBarriers_.resize(nfix);
+	// Broadie-Glasserman-Kou: a barrier monitored every dt is close to a continuous one
+	// shifted away from the spot by exp(beta * sigma * sqrt(dt)), beta = -zeta(1/2) / sqrt(2 pi)
+	const double beta = 0.5825971579390106;
+	double mondt = monitoringFreq_ == Freq::CONTINUOUS ? 0.0 : 1.0 / freqPerYear(monitoringFreq_);
+	for (size_t i = 0; i < nfix; ++i) {
+		bridgeVars_[i] = logVariances(i, 0);
+		double dt = fixTimes_[i] - (i > 0 ? fixTimes_[i - 1] : 0.0);
+		double shift = dt > 0.0 ? beta * std::sqrt(bridgeVars_[i] / dt * mondt) : 0.0;
+		bridgeBarriers_[i] = barrier_ * std::exp(up_or_down_ == 1 ? shift : -shift);
+	}
+}
+
+inline bool BarrierCallPut::knockOutBarriers(Vector& lower, Vector& upper) const
+{
+	size_t nfix = fixTimes_.size();
+	bool bridge = monitoringFreq_ != freq_ && bridgeBarriers_.n_elem == nfix;
+	lower.zeros(nfix);
+	upper.set_size(nfix);
+	upper.fill(std::numeric_limits<double>::infinity());
+	for (size_t i = 0; i < nfix; ++i) {
+		double barrier = bridge ? bridgeBarriers_[i] : barrier_;
+		if (up_or_down_ == 1)
+			upper[i] = barrier;
+		else
+			lower[i] = barrier;
+	}
+	return true;
+}
+
+inline void BarrierCallPut::eval(Matrix const& pricePath)
+{
+	size_t nfix = fixTimes_.size();
+	payAmounts_.zeros();
+	payAmounts_[nfix - 1] = pathPayoff(pricePath.colptr(0), 1);
+}
+
+inline double BarrierCallPut::pathPayoff(double const* spots, size_t stride) const
+{
+	size_t nfix = fixTimes_.size();
+	bool bridge = monitoringFreq_ != freq_;
+	ORF_ASSERT(!bridge || bridgeVars_.n_elem == nfix,
+		"BarrierCallPut: monitoring between fixings needs the bridge data from the pricer!");
+
+	double survival = 1.0;
+	double prevspot = bridgeSpot_;
+	for (size_t i = 0; i < nfix; ++i) {
+		double spot = spots[i * stride];
+		double barrier = bridge ? bridgeBarriers_[i] : barrier_;
+		if ((up_or_down_ == 1 && spot >= barrier) || (up_or_down_ == 0 && spot <= barrier))
+			return 0.0;   // knocked out at the fixing
+		if (bridge && bridgeVars_[i] > 0.0) {
+			if ((up_or_down_ == 1 && prevspot >= barrier) || (up_or_down_ == 0 && prevspot <= barrier))
+				return 0.0;
+			// the probability that the bridge from prevspot to spot crosses the barrier
+			double crossprob = std::exp(-2.0 * std::log(prevspot / barrier) * std::log(spot / barrier) / bridgeVars_[i]);
+			survival *= 1.0 - crossprob;
+		}
+		prevspot = spot;
+	}
+	double payoff = (prevspot - strike_) * payoffType_;
+	return payoff > 0.0 ? survival * payoff : 0.0;
+}
+
+inline void BarrierCallPut::evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs)
+{
+	size_t npaths = paths.n_rows;
+	ORF_ASSERT(paths.n_cols == fixTimes_.size(), "BarrierCallPut: number of fixings mismatch in the paths!");
+	pvs.set_size(npaths);
+	double df = discfactors[fixTimes_.size() - 1];
+	for (size_t p = 0; p < npaths; ++p)
+		pvs[p] = df * pathPayoff(paths.memptr() + p, npaths);
+}
+
+inline bool BarrierCallPut::hasStreamingEval() const
+{
+	return true;
+}
+
+inline void BarrierCallPut::startPath()
+{
+	ORF_ASSERT(monitoringFreq_ == freq_ || bridgeVars_.n_elem == fixTimes_.size(),
+		"BarrierCallPut: monitoring between fixings needs the bridge data from the pricer!");
+	streamSurvival_ = 1.0;
+	streamPrevSpot_ = bridgeSpot_;
+	streamKnockedOut_ = false;
+}
+
+inline bool BarrierCallPut::observeFixing(size_t idx, Vector const& spots)
+{
+	// one iteration of the loop of eval(pricePath)
+	bool bridge = monitoringFreq_ != freq_;
+	double spot = spots[0];
+	double barrier = bridge ? bridgeBarriers_[idx] : barrier_;
+	if ((up_or_down_ == 1 && spot >= barrier) || (up_or_down_ == 0 && spot <= barrier)) {
+		streamKnockedOut_ = true;
+		return false;
+	}
+	if (bridge && bridgeVars_[idx] > 0.0) {
+		if ((up_or_down_ == 1 && streamPrevSpot_ >= barrier) || (up_or_down_ == 0 && streamPrevSpot_ <= barrier)) {
+			streamKnockedOut_ = true;
+			return false;
+		}
+		double crossprob = std::exp(-2.0 * std::log(streamPrevSpot_ / barrier) * std::log(spot / barrier) / bridgeVars_[idx]);
+		streamSurvival_ *= 1.0 - crossprob;
+	}
+	streamPrevSpot_ = spot;
+	return true;
+}
+
+inline void BarrierCallPut::finishPath()
+{
+	payAmounts_.zeros();
+	if (streamKnockedOut_)
+		return;
+	double payoff = (streamPrevSpot_ - strike_) * payoffType_;
+	payAmounts_[fixTimes_.size() - 1] = payoff > 0.0 ? streamSurvival_ * payoff : 0.0;
+}
+
 // This product has as many fixings as num_freq between 0 and time to expiration.
+inline bool BarrierCallPut::evalPathwise(Matrix const& pricePath, Matrix&)
+{
+	eval(pricePath);
+	return false;
+}
+
 inline void BarrierCallPut::eval(size_t idx, Vector const& spots, double contValue)
 {
 	double spot = spots[0];
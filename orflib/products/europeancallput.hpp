@@ -12,7 +12,7 @@ BEGIN_NAMESPACE(orf)
 
 /** The European call/put class
 */
-class EuropeanCallPut : public Product
+class EuropeanCallPut : public BatchedProduct<EuropeanCallPut>
 {
 public:
   /** Initializing ctor */
@@ -21,12 +21,38 @@ public:
   /** The number of assets this product depends on */
   virtual size_t nAssets() const override { return 1; }
 
+  /** The payoff type, 1: call; -1 put */
+  int payoffType() const { return payoffType_; }
+
+  /** The strike */
+  double strike() const { return strike_; }
+
+  /** The time to expiration */
+  double timeToExp() const { return timeToExp_; }
+
+  /** Returns a copy of this product */
+  virtual SPtrProduct clone() const override;
+
   /** Evaluates the product given the passed-in path
       The "pricePath" matrix must have as many rows as
       the number of fixing times
   */
   virtual void eval(Matrix const& pricePath) override;
 
+  /** Evaluates the product and the derivative of the payment with respect to the spot */
+  virtual bool evalPathwise(Matrix const& pricePath, Matrix& payDerivs) override;
+
+  /** Streaming evaluation: the payment only depends on the first fixing */
+  virtual void startPath() override;
+  virtual bool observeFixing(size_t idx, Vector const& spots) override;
+  virtual void finishPath() override;
+  virtual bool hasStreamingEval() const override;
+
+  /** Evaluates the product on a block of paths; reads its single fixing and payment.
+      AmericanCallPut, which has more, overrides it
+  */
+  virtual void evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs) override;
+
   /** Evaluates the product at fixing time index idx
   */
   virtual void eval(size_t idx, Vector const& spots, double contValue) override;
@@ -35,6 +61,7 @@ protected:
   int payoffType_;     // 1: call; -1 put
   double strike_;
   double timeToExp_;
+  double streamSpot_;  // the spot at the first fixing, for the streaming evaluation
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -42,7 +69,7 @@ protected:
 
 inline
 EuropeanCallPut::EuropeanCallPut(int payoffType, double strike, double timeToExp)
-  : payoffType_(payoffType), strike_(strike), timeToExp_(timeToExp)
+  : payoffType_(payoffType), strike_(strike), timeToExp_(timeToExp), streamSpot_(0.0)
 {
   ORF_ASSERT(payoffType == 1 || payoffType == -1, "EuropeanCallPut: the payoff type must be 1 (call) or -1 (put)!");
   ORF_ASSERT(strike > 0.0, "EuropeanCallPut: the strike must be positive!");
@@ -61,6 +88,11 @@ EuropeanCallPut::EuropeanCallPut(int payoffType, double strike, double timeToExp
   payAmounts_.resize(1);
 }
 
+inline SPtrProduct EuropeanCallPut::clone() const
+{
+  return SPtrProduct(new EuropeanCallPut(*this));
+}
+
 inline void EuropeanCallPut::eval(Matrix const& pricePath)
 {
   double S_T = pricePath(0, 0);
@@ -70,6 +102,56 @@ inline void EuropeanCallPut::eval(Matrix const& pricePath)
     payAmounts_[0] = S_T >= strike_ ? 0.0 : strike_ - S_T;
 }
 
+inline bool EuropeanCallPut::evalPathwise(Matrix const& pricePath, Matrix& payDerivs)
+{
+  eval(pricePath);
+  payDerivs.zeros(1, pricePath.n_elem);
+  double S_T = pricePath(0, 0);
+  if (payoffType_ == 1)
+    payDerivs(0, 0) = S_T >= strike_ ? 1.0 : 0.0;
+  else
+    payDerivs(0, 0) = S_T >= strike_ ? 0.0 : -1.0;
+  return true;
+}
+
+inline void EuropeanCallPut::startPath()
+{
+  streamSpot_ = 0.0;
+}
+
+inline bool EuropeanCallPut::observeFixing(size_t idx, Vector const& spots)
+{
+  if (idx == 0)
+    streamSpot_ = spots[0];
+  return false;
+}
+
+inline void EuropeanCallPut::finishPath()
+{
+  double S_T = streamSpot_;
+  if (payoffType_ == 1)
+    payAmounts_[0] = S_T >= strike_ ? S_T - strike_ : 0.0;
+  else
+    payAmounts_[0] = S_T >= strike_ ? 0.0 : strike_ - S_T;
+}
+
+inline bool EuropeanCallPut::hasStreamingEval() const
+{
+  return true;
+}
+
+inline void EuropeanCallPut::evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs)
+{
+  size_t npaths = paths.n_rows;
+  pvs.set_size(npaths);
+  double const* S_T = paths.colptr(0);
+  double df = discfactors[0];
+  for (size_t p = 0; p < npaths; ++p) {
+    double payoff = (S_T[p] - strike_) * payoffType_;
+    pvs[p] = payoff > 0.0 ? df * payoff : 0.0;
+  }
+}
+
 // This product has only one fixing.
 inline void EuropeanCallPut::eval(size_t idx, Vector const& spots, double contValue)
 {
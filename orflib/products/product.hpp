@@ -13,6 +13,11 @@
 
 BEGIN_NAMESPACE(orf)
 
+class Product;
+
+/** Smart pointer to Product */
+using SPtrProduct = std::shared_ptr<Product>;
+
 /** The abstract base class for all financial products.
     It must be inherited by specific product payoffs.
 */
@@ -37,17 +42,98 @@ public:
   /** Returns the number of assets this product depends on */
   virtual size_t nAssets() const = 0;
 
+  /** Returns a copy of this product.
+      Used by the Monte Carlo pricers to give each worker thread its own payment amounts.
+  */
+  virtual SPtrProduct clone() const = 0;
+
+  /** Returns a product with a closed form price, strongly correlated with this one,
+      that the Monte Carlo pricers can use as a control variate.
+      Its fixing times must be a subset of the fixing times of this product.
+      The default returns an empty pointer, i.e. no control variate.
+  */
+  virtual SPtrProduct controlVariate() const;
+
   /** Evaluates the product given the passed-in path
       The "pricePath" matrix must have as many rows as the number of fixing times
   */
   virtual void eval(Matrix const& pricePath) = 0;
 
+  /** Streaming evaluation, for the Monte Carlo pricers that simulate a path one fixing at a time
+      and do not keep it. startPath() starts a new path; observeFixing(idx, spots) passes the spot of
+      each asset at fixing idx, for idx = 0, 1, ... in order; finishPath() sets the payment amounts
+      to those eval(pricePath) would set on the whole path.
+      observeFixing returns false once the payments no longer depend on the later fixings, e.g. when
+      a barrier is knocked out; the pricer may then skip them and call finishPath() right away.
+      The default implementation collects the fixings in a matrix and calls eval(pricePath) at the end.
+  */
+  virtual void startPath();
+  virtual bool observeFixing(size_t idx, Vector const& spots);
+  virtual void finishPath();
+
+  /** Returns true if the product overrides the streaming evaluation with a state whose size does not
+      depend on the number of fixings. The default returns false, and the Monte Carlo pricers then
+      evaluate whole paths instead of streaming them, since the default keeps the whole path anyway.
+  */
+  virtual bool hasStreamingEval() const;
+
+  /** Evaluates the product on a block of price paths and returns their PVs in pvs, one per path.
+      The paths are in the layout of PathGenerator::nextBlock: the spot of asset j at fixing i of
+      path p is paths(p, j * nfixings + i). discfactors holds the discount factor of each payment.
+      The payment amounts are left unspecified.
+      The default implementation evaluates path by path with the streaming evaluation; products
+      override it with a loop over the block that makes no virtual calls and reads only the
+      payments that can be nonzero.
+  */
+  virtual void evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs);
+
+  /** Evaluates the product given the passed-in path, like eval(pricePath), and for products
+      whose payment amounts are Lipschitz continuous in the path, e.g. calls and puts,
+      returns true and sets payDerivs(i, k) to the derivative of payment amount i with
+      respect to element k of pricePath (in column major order).
+      The Monte Carlo pricers use them for pathwise Greeks.
+      The default implementation only calls eval(pricePath) and returns false, i.e. the
+      payoff is treated as discontinuous, and the likelihood ratio Greeks are used.
+      The returned value must not depend on the path.
+  */
+  virtual bool evalPathwise(Matrix const& pricePath, Matrix& payDerivs);
+
+  /** Passes the model data needed to evaluate the product between fixing times,
+      e.g. for a barrier monitored more often than fixed, with a Brownian bridge.
+      spots holds the initial spot of each asset; logVariances(i, j) holds the variance
+      of the log spot of asset j from fixing time i-1 to fixing time i, where
+      fixing time -1 is t = 0. Called by the Monte Carlo pricers before simulating.
+      The default implementation ignores the data.
+  */
+  virtual void setBridgeData(Vector const& spots, Matrix const& logVariances);
+
+  /** For products that pay nothing once asset 0 fixes at or beyond a barrier,
+      returns true and the lower and upper barriers at each fixing
+      (0 and infinity where there is none). The Monte Carlo pricers use them
+      to stop simulating knocked out paths early. The default returns false.
+  */
+  virtual bool knockOutBarriers(Vector& lower, Vector& upper) const;
+
   /** Evaluates the product at fixing time index idx, for a vector of current spots,
       and a given continuation value.
       Useful for PDE pricing of products with early exercise features.
   */
   virtual void eval(size_t idx, Vector const& spots, double contValue) = 0;
 
+  /** Returns the value of exercising the product at fixing time index idx, for a vector of
+      current spots, e.g. for the regression of the least squares Monte Carlo pricer.
+      The default implementation returns payment amount idx after eval(idx, spots, 0.0);
+      products override it to compute the value alone, without touching the payment amounts.
+  */
+  virtual double exerciseValue(size_t idx, Vector const& spots);
+
+  /** Evaluates the product at fixing time index idx on every node of a one asset grid:
+      spots[k] is the spot at node k and values[k] the continuation value there on input,
+      and payment amount idx on output. The PDE solvers use it once per product event.
+      The default implementation calls eval(idx, spots, contValue) node by node.
+  */
+  virtual void evalGrid(size_t idx, Vector const& spots, double* values);
+
   /** Sets up the time steps, to be used in a numerical method.
   The timesteps are returned in the std::vector<double> timesteps,
   and for each timestep, the corresponding index in the fixingTimes() array
@@ -64,10 +150,26 @@ protected:
   Vector fixTimes_;       // the fixing (observation) times
   Vector payTimes_;       // the payment times
   Vector payAmounts_;     // the payment times
+
+private:
+  Matrix streamPath_;     // the fixings of the path so far, for the default streaming evaluation
+  Vector blockSpots_;     // the spots of one fixing, for the default block and grid evaluations
 };
 
-/** Smart pointer to Product */
-using SPtrProduct = std::shared_ptr<Product>;
+/** Base class template for the products, to be derived from as
+    class MyProduct : public BatchedProduct<MyProduct> or, to extend an existing product,
+    class MyProduct : public BatchedProduct<MyProduct, ExistingProduct>.
+    It implements the loop over the nodes of evalGrid with direct calls to
+    DERIVED::eval(idx, spots, contValue), which the compiler can inline.
+*/
+template <typename DERIVED, typename BASE = Product>
+class BatchedProduct : public BASE
+{
+public:
+  using BASE::BASE;
+
+  virtual void evalGrid(size_t idx, Vector const& spots, double* values) override;
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 // Inline definitions
@@ -77,6 +179,109 @@ Product::Product(std::string const& payccy)
 : payccy_(payccy)
 {}
 
+inline
+bool Product::evalPathwise(Matrix const& pricePath, Matrix&)
+{
+  eval(pricePath);
+  return false;
+}
+
+inline
+void Product::startPath()
+{
+  streamPath_.set_size(fixTimes_.n_elem, nAssets());
+}
+
+inline
+bool Product::observeFixing(size_t idx, Vector const& spots)
+{
+  for (size_t j = 0; j < streamPath_.n_cols; ++j)
+    streamPath_(idx, j) = spots[j];
+  return true;
+}
+
+inline
+void Product::finishPath()
+{
+  eval(streamPath_);
+}
+
+inline
+bool Product::hasStreamingEval() const
+{
+  return false;
+}
+
+inline
+void Product::evalBlock(Matrix const& paths, Vector const& discfactors, Vector& pvs)
+{
+  size_t nfix = fixTimes_.n_elem;
+  size_t nassets = nAssets();
+  ORF_ASSERT(paths.n_cols == nfix * nassets, "Product: the paths must have one column per fixing and asset!");
+  pvs.set_size(paths.n_rows);
+  blockSpots_.set_size(nassets);
+  for (size_t p = 0; p < paths.n_rows; ++p) {
+    startPath();
+    for (size_t i = 0; i < nfix; ++i) {
+      for (size_t j = 0; j < nassets; ++j)
+        blockSpots_[j] = paths(p, j * nfix + i);
+      if (!observeFixing(i, blockSpots_))
+        break;
+    }
+    finishPath();
+    double pv = 0.0;
+    for (size_t i = 0; i < payAmounts_.size(); ++i)
+      pv += discfactors[i] * payAmounts_[i];
+    pvs[p] = pv;
+  }
+}
+
+inline
+double Product::exerciseValue(size_t idx, Vector const& spots)
+{
+  eval(idx, spots, 0.0);
+  return payAmounts_[idx];
+}
+
+inline
+void Product::evalGrid(size_t idx, Vector const& spots, double* values)
+{
+  blockSpots_.set_size(1);
+  for (size_t k = 0; k < spots.n_elem; ++k) {
+    blockSpots_[0] = spots[k];
+    eval(idx, blockSpots_, values[k]);
+    values[k] = payAmounts_[idx];
+  }
+}
+
+template <typename DERIVED, typename BASE>
+void BatchedProduct<DERIVED, BASE>::evalGrid(size_t idx, Vector const& spots, double* values)
+{
+  DERIVED& self = static_cast<DERIVED&>(*this);
+  Vector spot(1);
+  for (size_t k = 0; k < spots.n_elem; ++k) {
+    spot[0] = spots[k];
+    self.DERIVED::eval(idx, spot, values[k]);
+    values[k] = this->payAmounts_[idx];
+  }
+}
+
+inline
+void Product::setBridgeData(Vector const&, Matrix const&)
+{}
+
+inline
+bool Product::knockOutBarriers(Vector&, Vector&) const
+{
+  return false;
+}
+
+inline
+SPtrProduct Product::controlVariate() const
+{
+  return SPtrProduct();
+}
+
 inline
 Vector const& Product::fixTimes() const
 {
@@ -6,14 +6,18 @@
 #include <orflib/market/market.hpp>
 #include <orflib/products/europeancallput.hpp>
 #include <orflib/products/asianbasketcallput.hpp>
+#include <orflib/products/americancallput.hpp>
 #include <orflib/pricers/bsmcpricer.hpp>
 #include <orflib/pricers/multiassetbsmcpricer.hpp>
-#include <orflib/math/stats/meanvarcalculator.hpp>
+#include <orflib/pricers/lsmbsmcpricer.hpp>
+#include <orflib/math/stats/stratifiedmeanvarcalculator.hpp>
 
 #include <xlorflib/xlutils.hpp>
 #include <xlw/xlw.h>
 
 #include <cmath>
+#include <string>
+#include <vector>
 
 using namespace xlw;
 using namespace orf;
@@ -46,7 +50,17 @@ LPXLFOPER EXCEL_EXPORT xlOrfEuroBSMC(LPXLFOPER xlPayoffType,
   ORF_ASSERT(spyc, "error: yield curve " + name + " not found");
 
   double divYield = XlfOper(xlDivYield).AsDouble();
-  double vol = XlfOper(xlVolatility).AsDouble();
+  // a constant volatility, or the name of a volatility term structure
+  SPtrVolatilityTermStructure spvol;
+  if (XlfOper(xlVolatility).IsNumber()) {
+    double vol = XlfOper(xlVolatility).AsDouble();
+    spvol.reset(new VolatilityTermStructure(&timeToExp, &timeToExp + 1, &vol, &vol + 1));
+  }
+  else {  // assume string
+    std::string volname = xlStripTick(XlfOper(xlVolatility).AsString());
+    spvol = market().volatilities().get(volname);
+    ORF_ASSERT(spvol, "error: volatility " + volname + " not found");
+  }
   // read the MC parameters
   McParams mcparams = xlOperToMcParams(XlfOper(xlMcParams));
   // read the number of paths
@@ -61,27 +75,41 @@ LPXLFOPER EXCEL_EXPORT xlOrfEuroBSMC(LPXLFOPER xlPayoffType,
   // create the product
   SPtrProduct spprod(new EuropeanCallPut(payoffType, strike, timeToExp));
   // create the pricer
-  BsMcPricer bsmcpricer(spprod, spyc, divYield, vol, spot, mcparams);
-  // create the statistics calculator
-  MeanVarCalculator<double *> sc(bsmcpricer.nVariables());
+  BsMcPricer bsmcpricer(spprod, spyc, divYield, spvol, spot, mcparams);
+  // create the statistics calculator; stratified paths are sampled in groups
+  StratifiedMeanVarCalculator<double *> sc(bsmcpricer.nVariables(), mcSampleGroupSize(mcparams));
   // run the simulation
-  bsmcpricer.simulate(sc, npaths);
+  McRunInfo runinfo = bsmcpricer.simulate(sc, npaths);
   // collect results
   Matrix const& results = sc.results();
-  // read out results
   size_t nsamples = sc.nSamples();
-  double mean = results(0, 0);
-  double stderror = results(1, 0);
-  stderror = std::sqrt(stderror / nsamples);
+  size_t nvars = bsmcpricer.nVariables();
+  // with a tolerance or a time budget, also report the paths used and the elapsed time
+  bool rounds = mcparams.absTolerance > 0.0 || mcparams.relTolerance > 0.0 || mcparams.maxSeconds > 0.0;
 
-  // write results to the outbound XlfOper
+  // write results to the outbound XlfOper, one column per variable:
+  // the price, and with McParams GREEKS, delta, gamma, vega and the rho to each forward rate of the curve
+  std::vector<std::string> names = { "Price", "Delta", "Gamma", "Vega" };
+  for (size_t k = 1; names.size() < nvars; ++k)
+    names.push_back("Rho" + std::to_string(k));
   RW offset = headers ? 1 : 0;
-  XlfOper xlRet(2 + offset, 1); // construct a range of size 2 x 1
-  if (headers) {
-    xlRet(0, 0) = "Price";
+  RW nrows = rounds ? 4 : 2;
+  XlfOper xlRet(nrows + offset, (COL)nvars); // construct a range of size nrows x nvars
+  for (size_t j = 0; j < nvars; ++j) {
+    if (headers) {
+      xlRet(0, (COL)j) = names[j].c_str();
+    }
+    xlRet(offset, (COL)j) = results(0, j);                              // mean
+    xlRet(offset + 1, (COL)j) = std::sqrt(results(1, j) / nsamples);    // standard error
+    if (rounds) {
+      xlRet(offset + 2, (COL)j) = "";
+      xlRet(offset + 3, (COL)j) = "";
+    }
+  }
+  if (rounds) {
+    xlRet(offset + 2, 0) = (double)runinfo.npaths;   // paths used
+    xlRet(offset + 3, 0) = runinfo.seconds;          // elapsed time
   }
-  xlRet(offset, 0) = mean;
-  xlRet(offset + 1, 0) = stderror;
 
   return xlRet;
 
@@ -117,7 +145,15 @@ LPXLFOPER EXCEL_EXPORT xlOrfAsianBasketBSMC(LPXLFOPER xlPayoffType,
   ORF_ASSERT(spyc, "error: yield curve " + name + " not found");
 
   Vector divYields = xlOperToVector(XlfOper(xlDivYields));
-  Vector vols = xlOperToVector(XlfOper(xlVolatilities));
+  // constant volatilities, one per asset
+  Vector volvals = xlOperToVector(XlfOper(xlVolatilities));
+  double lastFixing = fixingTimes[fixingTimes.n_elem - 1];
+  std::vector<SPtrVolatilityTermStructure> vols;
+  for (size_t j = 0; j < volvals.n_elem; ++j) {
+    double vol = volvals[j];
+    vols.push_back(SPtrVolatilityTermStructure(
+      new VolatilityTermStructure(&lastFixing, &lastFixing + 1, &vol, &vol + 1)));
+  }
   Matrix correlMat = xlOperToMatrix(XlfOper(xlCorrelationMatrix));
 
   // read the MC parameters
@@ -135,12 +171,104 @@ LPXLFOPER EXCEL_EXPORT xlOrfAsianBasketBSMC(LPXLFOPER xlPayoffType,
   SPtrProduct spprod(new AsianBasketCallPut(payoffType, strike, fixingTimes, assetQuantities));
   // create the pricer
   MultiAssetBsMcPricer bsmcpricer(spprod, spyc, divYields, vols, spots, correlMat, mcparams);
-  // create the statistics calculator
-  MeanVarCalculator<double *> sc(bsmcpricer.nVariables());
+  // create the statistics calculator; stratified paths are sampled in groups
+  StratifiedMeanVarCalculator<double *> sc(bsmcpricer.nVariables(), mcSampleGroupSize(mcparams));
   // run the simulation
   bsmcpricer.simulate(sc, npaths);
   // collect results
   Matrix const & results = sc.results();
+  size_t nsamples = sc.nSamples();
+  size_t nvars = bsmcpricer.nVariables();
+
+  // write results to the outbound XlfOper, one column per variable: the price, and with
+  // McParams GREEKS, the delta and vega of each asset and the rho to each forward rate of the curve
+  size_t nassets = spots.n_elem;
+  std::vector<std::string> names(1, "Price");
+  for (size_t j = 1; j <= nassets && names.size() < nvars; ++j)
+    names.push_back("Delta" + std::to_string(j));
+  for (size_t j = 1; j <= nassets && names.size() < nvars; ++j)
+    names.push_back("Vega" + std::to_string(j));
+  for (size_t k = 1; names.size() < nvars; ++k)
+    names.push_back("Rho" + std::to_string(k));
+  RW offset = headers ? 1 : 0;
+  XlfOper xlRet(2 + offset, (COL)nvars); // construct a range of size 2 x nvars
+  for (size_t j = 0; j < nvars; ++j) {
+    if (headers) {
+      xlRet(0, (COL)j) = names[j].c_str();
+    }
+    xlRet(offset, (COL)j) = results(0, j);                              // mean
+    xlRet(offset + 1, (COL)j) = std::sqrt(results(1, j) / nsamples);    // standard error
+  }
+
+  return xlRet;
+
+  EXCEL_END;
+}
+
+LPXLFOPER EXCEL_EXPORT xlOrfAmerBSMC(LPXLFOPER xlPayoffType,
+                                     LPXLFOPER xlStrike,
+                                     LPXLFOPER xlTimeToExp,
+                                     LPXLFOPER xlSpot,
+                                     LPXLFOPER xlDiscountCrv,
+                                     LPXLFOPER xlDivYield,
+                                     LPXLFOPER xlVolatility,
+                                     LPXLFOPER xlMcParams,
+                                     LPXLFOPER xlNPaths,
+                                     LPXLFOPER xlNRegPaths,
+                                     LPXLFOPER xlHeaders)
+{
+  EXCEL_BEGIN;
+
+  if (XlfExcel::Instance().IsCalledByFuncWiz())
+    return XlfOper(true);
+
+  int payoffType = XlfOper(xlPayoffType).AsInt();
+  Vector spots(1);
+  spots[0] = XlfOper(xlSpot).AsDouble();
+  double strike = XlfOper(xlStrike).AsDouble();
+  double timeToExp = XlfOper(xlTimeToExp).AsDouble();
+
+  std::string name = xlStripTick(XlfOper(xlDiscountCrv).AsString());
+  SPtrYieldCurve spyc = market().yieldCurves().get(name);
+  ORF_ASSERT(spyc, "error: yield curve " + name + " not found");
+
+  Vector divYields(1);
+  divYields[0] = XlfOper(xlDivYield).AsDouble();
+  Vector vols(1);
+  vols[0] = XlfOper(xlVolatility).AsDouble();
+  // read the MC parameters
+  McParams mcparams = xlOperToMcParams(XlfOper(xlMcParams));
+  // read the number of paths
+  unsigned long npaths = XlfOper(xlNPaths).AsInt();
+  // read the number of regression paths; none means one pass over the regression paths
+  unsigned long nregpaths = 0;
+  if (!XlfOper(xlNRegPaths).IsMissing() && !XlfOper(xlNRegPaths).IsNil())
+    nregpaths = XlfOper(xlNRegPaths).AsInt();
+  // handling the xlHeaders argument
+  bool headers;
+  if (XlfOper(xlHeaders).IsMissing() || XlfOper(xlHeaders).IsNil())
+    headers = false;
+  else
+    headers = XlfOper(xlHeaders).AsBool();
+
+  // create the product
+  SPtrProduct spprod(new AmericanCallPut(payoffType, strike, timeToExp));
+  // create the pricer
+  LsmBsMcPricer lsmpricer(spprod, spyc, divYields, vols, spots, Matrix(), mcparams);
+  // create the statistics calculator; stratified paths are sampled in groups, except the
+  // regression paths, which are stratified as one block
+  StratifiedMeanVarCalculator<double *> sc(lsmpricer.nVariables(), nregpaths > 0 ? mcSampleGroupSize(mcparams) : 1);
+  // run the regression, then the simulation
+  if (nregpaths > 0) {
+    lsmpricer.regress(nregpaths);
+    lsmpricer.simulate(sc, npaths);
+  }
+  else {
+    lsmpricer.regress(npaths);
+    lsmpricer.simulateRegressionPaths(sc);
+  }
+  // collect results
+  Matrix const& results = sc.results();
   // read out results
   double mean = results(0, 0);
   double stderror = results(1, 0);
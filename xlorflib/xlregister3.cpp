@@ -16,13 +16,13 @@ namespace {
     { "Spot", "spot", "XLF_OPER" },
     { "DiscountCrv", "name of the discount curve", "XLF_OPER" },
     { "DivYield", "dividend yield (cont. cmpd.)", "XLF_OPER" },
-    { "Vol", "volatility", "XLF_OPER" },
+    { "Vol", "volatility, or name of the volatility term structure", "XLF_OPER" },
     { "McParams", "Default: UrngType=MT19937; PathGenType=EULER", "XLF_OPER" },
-    { "NPaths", "The number of Monte-Carlo paths", "XLF_OPER" },
+    { "NPaths", "The number of Monte-Carlo paths; the maximum with McParam ABSTOL, RELTOL or MAXTIME", "XLF_OPER" },
     { "Headers", "TRUE for displaying the header", "XLF_OPER" }
   };
   XLRegistration::XLFunctionRegistrationHelper regOrfEuroBSMC(
-    "xlOrfEuroBSMC", "ORF.EUROBSMC", "Price of a European option in the Black-Scholes model using Monte Carlo.",
+    "xlOrfEuroBSMC", "ORF.EUROBSMC", "Price, and Greeks with McParam GREEKS, of a European option in the Black-Scholes model using Monte Carlo.",
     "ORFLIB", OrfEuroBSMCArgs, 10);
 
   // Register the function ORF.ASIANBASKETBSMC
@@ -41,7 +41,25 @@ namespace {
     { "Headers", "TRUE for displaying the header", "XLF_OPER" }
   };
   XLRegistration::XLFunctionRegistrationHelper regOrfAsianBasketBSMC(
-    "xlOrfAsianBasketBSMC", "ORF.ASIANBASKETBSMC", "Price of an Asian call/put option on a basket of assets in the Black-Scholes model using Monte Carlo.",
+    "xlOrfAsianBasketBSMC", "ORF.ASIANBASKETBSMC", "Price, and Greeks with McParam GREEKS, of an Asian call/put option on a basket of assets in the Black-Scholes model using Monte Carlo.",
     "ORFLIB", OrfAsianBasketBSMCArgs, 12);
 
+  // Register the function ORF.AMERBSMC
+  XLRegistration::Arg OrfAmerBSMCArgs[] = {
+    { "PayoffType", "1: call; -1: put", "XLF_OPER" },
+    { "Strike", "strike", "XLF_OPER" },
+    { "TimeToExp", "time to expiration", "XLF_OPER" },
+    { "Spot", "spot", "XLF_OPER" },
+    { "DiscountCrv", "name of the discount curve", "XLF_OPER" },
+    { "DivYield", "dividend yield (cont. cmpd.)", "XLF_OPER" },
+    { "Vol", "volatility", "XLF_OPER" },
+    { "McParams", "Default: UrngType=MT19937; PathGenType=EULER", "XLF_OPER" },
+    { "NPaths", "The number of Monte-Carlo paths", "XLF_OPER" },
+    { "NRegPaths", "The number of regression paths. Default: prices on the NPaths regression paths", "XLF_OPER" },
+    { "Headers", "TRUE for displaying the header", "XLF_OPER" }
+  };
+  XLRegistration::XLFunctionRegistrationHelper regOrfAmerBSMC(
+    "xlOrfAmerBSMC", "ORF.AMERBSMC", "Price of an American option in the Black-Scholes model using least-squares Monte Carlo.",
+    "ORFLIB", OrfAmerBSMCArgs, 11);
+
 }  // anonymous namespace
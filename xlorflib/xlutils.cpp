@@ -267,6 +267,8 @@ orf::McParams xlOperToMcParams(xlw::XlfOper xlRange)
         mcparams.urngType = McParams::UrngType::RANLUX3;
       else if (paramvalue == "RANLUX4")
         mcparams.urngType = McParams::UrngType::RANLUX4;
+      else if (paramvalue == "PHILOX")
+        mcparams.urngType = McParams::UrngType::PHILOX;
       else if (paramvalue == "SOBOL")
         mcparams.urngType = McParams::UrngType::SOBOL;
       else
@@ -278,9 +280,76 @@ orf::McParams xlOperToMcParams(xlw::XlfOper xlRange)
       std::transform(paramvalue.begin(), paramvalue.end(), paramvalue.begin(), ::toupper);
       if (paramvalue == "EULER")
         mcparams.pathGenType = McParams::PathGenType::EULER;
+      else if (paramvalue == "BROWNIAN_BRIDGE")
+        mcparams.pathGenType = McParams::PathGenType::BROWNIAN_BRIDGE;
       else
         ORF_ASSERT(0, "xlOperToMcParams: invalid value for McParam " + paramname + "!");
     }
+    else  if (paramname == "CORRELFACTORTYPE") {
+      std::string paramvalue = xlRange(i, 1).AsString();
+      paramvalue = orf::trim(paramvalue);
+      std::transform(paramvalue.begin(), paramvalue.end(), paramvalue.begin(), ::toupper);
+      if (paramvalue == "CHOLESKY")
+        mcparams.correlFactorType = McParams::CorrelFactorType::CHOLESKY;
+      else if (paramvalue == "PCA")
+        mcparams.correlFactorType = McParams::CorrelFactorType::PCA;
+      else if (paramvalue == "FACTOR_MODEL")
+        mcparams.correlFactorType = McParams::CorrelFactorType::FACTOR_MODEL;
+      else
+        ORF_ASSERT(0, "xlOperToMcParams: invalid value for McParam " + paramname + "!");
+    }
+    else  if (paramname == "STRATIFICATION") {
+      std::string paramvalue = xlRange(i, 1).AsString();
+      paramvalue = orf::trim(paramvalue);
+      std::transform(paramvalue.begin(), paramvalue.end(), paramvalue.begin(), ::toupper);
+      if (paramvalue == "NONE")
+        mcparams.stratification = McParams::StratificationType::NONE;
+      else if (paramvalue == "TERMINAL")
+        mcparams.stratification = McParams::StratificationType::TERMINAL;
+      else if (paramvalue == "LATIN_HYPERCUBE")
+        mcparams.stratification = McParams::StratificationType::LATIN_HYPERCUBE;
+      else
+        ORF_ASSERT(0, "xlOperToMcParams: invalid value for McParam " + paramname + "!");
+    }
+    else if (paramname == "NCORRELFACTORS") {
+      int paramvalue = xlRange(i, 1).AsInt();
+      ORF_ASSERT(paramvalue >= 1, "xlOperToMcParams: the number of common factors must be positive!");
+      mcparams.nCorrelFactors = paramvalue;
+    }
+    else if (paramname == "NTHREADS") {
+      int paramvalue = xlRange(i, 1).AsInt();
+      ORF_ASSERT(paramvalue >= 0, "xlOperToMcParams: the number of threads must be non-negative!");
+      mcparams.nThreads = paramvalue;
+    }
+    else if (paramname == "NREPLICATIONS") {
+      int paramvalue = xlRange(i, 1).AsInt();
+      ORF_ASSERT(paramvalue >= 1, "xlOperToMcParams: the number of replications must be positive!");
+      mcparams.nReplications = paramvalue;
+    }
+    else if (paramname == "ABSTOL") {
+      mcparams.absTolerance = xlRange(i, 1).AsDouble();
+      ORF_ASSERT(mcparams.absTolerance >= 0.0, "xlOperToMcParams: the tolerance must be non-negative!");
+    }
+    else if (paramname == "RELTOL") {
+      mcparams.relTolerance = xlRange(i, 1).AsDouble();
+      ORF_ASSERT(mcparams.relTolerance >= 0.0, "xlOperToMcParams: the tolerance must be non-negative!");
+    }
+    else if (paramname == "MAXTIME") {
+      mcparams.maxSeconds = xlRange(i, 1).AsDouble();
+      ORF_ASSERT(mcparams.maxSeconds >= 0.0, "xlOperToMcParams: the time budget must be non-negative!");
+    }
+    else if (paramname == "ANTITHETIC")
+      mcparams.antithetic = xlRange(i, 1).AsBool();
+    else if (paramname == "MOMENTMATCHING")
+      mcparams.momentMatching = xlRange(i, 1).AsBool();
+    else if (paramname == "CONTROLVARIATE")
+      mcparams.controlVariate = xlRange(i, 1).AsBool();
+    else if (paramname == "GREEKS")
+      mcparams.greeks = xlRange(i, 1).AsBool();
+    else if (paramname == "IMPORTANCESAMPLING")
+      mcparams.importanceSampling = xlRange(i, 1).AsBool();
+    else if (paramname == "SINGLEPRECISION")
+      mcparams.singlePrecision = xlRange(i, 1).AsBool();
     else
       ORF_ASSERT(0, "xlOperToMcParams: unknown McParam " + paramname + "!");
   } // next row in the range